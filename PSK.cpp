@@ -10,11 +10,11 @@
  * audio data generated from the message and your specified mode.
  * 
  * Modes:
- * BPSK125, BPSK250, BPSK500
- * QPSK125, QPSK250, QPSK500
+ * BPSK31, BPSK63, BPSK125, BPSK250, BPSK500, BPSK1000
+ * QPSK31, QPSK63, QPSK125, QPSK250, QPSK500, QPSK1000
  * 
- * There currently is no support for the 31.25 or 62.5 baud modes, only
- * 125, 250, 500, and 1000 are supported. 
+ * Symbols are timed exactly at any sample rate (31.25 and 62.5 Sym/s for
+ * the 31 and 63 modes), see PSK::symbol_clock_.
  * 
  * It needs some work, especially on the filter, but it works fine and
  * generates clean enough audio (in BPSK 125, and 250 at least).
@@ -25,9 +25,62 @@
  */
 
 #include "PSK.h"
+#include "PSKFormat.h"
+#include "PSKModulator.h"
+#include "PSKSimd.h"
+#include "ThreadPool.h"
 
 #include <iostream> // Debugging
 #include <bitset> // Debugging
+#include <numeric>
+#include <cstring>
+#include <algorithm>
+#include <cctype>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define PSK_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if PSK_STATS
+#include <chrono>
+
+namespace {
+/**
+ * @brief Adds the time until it goes out of scope to 'seconds', does nothing
+ * if 'seconds' is null.
+ */
+class StatsTimer {
+    public:
+        explicit StatsTimer(double *seconds) : seconds_(seconds) {
+            if (seconds_ != nullptr) {
+                start_ = std::chrono::steady_clock::now();
+            }
+        }
+        ~StatsTimer() {
+            if (seconds_ != nullptr) {
+                std::chrono::duration<double> elapsed =
+                    std::chrono::steady_clock::now() - start_;
+                *seconds_ += elapsed.count();
+            }
+        }
+    private:
+        double *seconds_;
+        std::chrono::steady_clock::time_point start_;
+};
+}
+
+// Times the rest of the enclosing scope into stats_.field
+#define PSK_STATS_TIMER(field) \
+    StatsTimer stats_timer_(stats_enabled_ ? &stats_.field : nullptr)
+#define PSK_STATS_ADD(field, value) \
+    do { if (stats_enabled_) { stats_.field += (value); } } while (0)
+#else
+#define PSK_STATS_TIMER(field) do { } while (0)
+#define PSK_STATS_ADD(field, value) do { } while (0)
+#endif
 
 /**
  * @brief Construct a PSK Modulator object without morse callsign.
@@ -58,10 +111,47 @@ PSK::PSK(std::string file_path, Mode mode, SymbolRate sym_rate, std::string call
     setup(mode, sym_rate);
 }
 
+/**
+ * @brief Construct a PSK Modulator object with a custom sample rate, carrier
+ * frequency or preamble/postamble length.
+ * 
+ * @param file_path Path to where the wav file will be saved
+ * @param mode BPSK125, BPSK250, BPSK500, QPSK125, QPSK250, QPSK500
+ * @param config See PSK::Config
+ */
+PSK::PSK(std::string file_path, Mode mode, SymbolRate sym_rate, const Config &config) {
+    file_path_ = file_path;
+    call_sign_ = "";
+    morse_callsign_ = false;
+    setup(mode, sym_rate, config);
+}
+
 PSK::~PSK() {
 
 }
 
+/**
+ * @brief Sets the number of threads used to render large messages.
+ * @details Messages are only split when every thread gets at least
+ * parallel_min_words_ words of the bit stream. The output is identical to
+ * serial encoding.
+ * @param threads 1 (default) to encode on the calling thread only
+ */
+void PSK::setThreads(int threads) {
+    if (threads < 1) {
+        throw std::invalid_argument("Number of threads must be at least 1");
+    }
+    worker_templates_.clear();
+    thread_pool_.reset();
+    if (threads > 1) {
+        thread_pool_.reset(new ThreadPool(threads));
+        worker_templates_.resize(threads);
+        for (SymbolTemplates &templates : worker_templates_) {
+            resetSymbolTemplates(templates);
+        }
+    }
+}
+
 /**
  * @brief Encode a string of text data into PSK audio data and save to wave
  * file. 
@@ -75,220 +165,1477 @@ PSK::~PSK() {
  * @return true - Success, you can find the wav file at the file path specified
  * @return false - Failure, check the console for more information
  */
-bool PSK::encodeTextData(std::string message) {
-    if (!openFile(file_path_)) { // Open Wav File at Path
+bool PSK::encodeTextData(const std::string &message) {
+    resetState();
+    if (morse_callsign_) {
+        callSignSamples(); // Rejects an invalid callsign before the file is created
+    }
+    buildTextBitStream(message);
+    return encodeToFile();
+}
+
+/**
+ * @brief Encode a string of text data into PSK audio samples in memory.
+ * @details Same encoding as encodeTextData(const std::string &), but the samples are
+ * rendered directly into 'out' (appended to anything already in it) and no
+ * file is opened. The object can be reused for further messages.
+ * 
+ * @param message 
+ * @param out Vector that the 16 bit mono samples are appended to
+ * @return true - Success
+ */
+bool PSK::encodeTextData(const std::string &message, std::vector<int16_t> &out) {
+    resetState();
+    buildTextBitStream(message);
+    return encodeToVector(out);
+}
+
+/**
+ * @brief Encode a string of text data into PSK audio samples and pass them
+ * to a callback in blocks of up to the output chunk size.
+ * @details Useful for handing audio to a sound card or SDR sink without an
+ * intermediate file. The callback is called from within this method and the
+ * sample pointer is only valid for the duration of the call.
+ * 
+ * @param message 
+ * @param callback Called with each block of 16 bit mono samples
+ * @return true - Success
+ */
+bool PSK::encodeTextData(const std::string &message, SampleCallback callback) {
+    resetState();
+    buildTextBitStream(message);
+    return encodeToCallback(callback);
+}
+
+/**
+ * @brief Encode a string of text data into PSK audio and write it to a
+ * stream (for example std::cout) as it is rendered.
+ * @details The stream does not need to be seekable. With 'wav_header' a
+ * streaming style wav header is written first, with the size fields set to
+ * 0xFFFFFFFF as they are not known in advance. Without it, the output is raw
+ * 16 bit little endian mono PCM. The stream is flushed after every output
+ * chunk (see setOutputChunkSize()), so a reader receives audio as soon as it
+ * is rendered.
+ * 
+ * @param message 
+ * @param out Stream to write to, opened in binary mode
+ * @param wav_header Write a wav header before the samples
+ * @return true - Success
+ * @return false - Failure, the stream is in a failed state
+ */
+bool PSK::encodeTextData(const std::string &message, std::ostream &out, bool wav_header) {
+    resetState();
+    buildTextBitStream(message);
+    return encodeToStream(out, wav_header);
+}
+
+/**
+ * @brief Encode a string of text data into complex baseband (I/Q) samples.
+ * @details No carrier is generated. Each symbol becomes 'oversampling'
+ * complex samples of the shaped symbol sequence (same mapping and pulse shape
+ * as the audio), so the sample rate is symbol rate * oversampling. Samples
+ * are full scale (magnitude up to 1.0) and interleaved I, Q, appended to
+ * anything already in 'out'.
+ * 
+ * @param message 
+ * @param out Vector that the interleaved float samples are appended to
+ * @param oversampling Samples per symbol, at least 2
+ * @return true - Success
+ */
+bool PSK::encodeTextDataIQ(const std::string &message, std::vector<float> &out,
+                           int oversampling) {
+    resetState();
+    buildTextBitStream(message);
+    renderBaseband(oversampling, out);
+    return true;
+}
+
+/**
+ * @brief Encode a string of text data into interleaved 16 bit I/Q samples.
+ * See encodeTextDataIQ(const std::string &, std::vector<float> &, int).
+ * @param message 
+ * @param out Vector that the interleaved I, Q samples are appended to
+ * @param oversampling Samples per symbol, at least 2
+ * @return true - Success
+ */
+bool PSK::encodeTextDataIQ(const std::string &message, std::vector<int16_t> &out,
+                           int oversampling) {
+    std::vector<float> iq;
+    encodeTextDataIQ(message, iq, oversampling);
+    size_t size = out.size();
+    out.resize(size + iq.size());
+    for (size_t i = 0; i < iq.size(); i++) {
+        out[size + i] = (int16_t) std::lround(iq[i] * max_amplitude_);
+    }
+    return true;
+}
+
+/**
+ * @brief Encode a string of text data into a 2 channel (I, Q) 16 bit wav
+ * file at the file path. The wav sample rate is symbol rate * oversampling.
+ * @param message 
+ * @param oversampling Samples per symbol, at least 2. Must give a whole
+ * number sample rate (a multiple of 4 at 31.25 Sym/s, even at 62.5 Sym/s).
+ * @return true - Success
+ */
+bool PSK::encodeTextDataIQ(const std::string &message, int oversampling) {
+    double rate = symbol_rate_ * oversampling;
+    if (rate != std::floor(rate)) {
+        throw std::invalid_argument("Oversampling must give a whole number sample rate");
+    }
+    std::vector<int16_t> iq;
+    encodeTextDataIQ(message, iq, oversampling);
+    if (!openFile(file_path_)) {
         throw std::invalid_argument("Failed to open file at path: " + file_path_);
-    } else {
-        writeHeader(); // Write Wav Header on success
     }
+    writeHeader((int) rate, 2);
+    writeSamples(iq.data(), iq.size());
+    finalizeFile();
+    return true;
+}
+
+/**
+ * @brief Encode raw data into PSK audio and save it to a wave file.
+ * @details Adds preamble and postamble to the audio, and the callsign.
+ * Does *not* use varicode! The bytes are sent MSB first as they are (in QPSK
+ * mode through the convolutional code, like every other bit), optionally
+ * framed with a length prefix and a CRC (see RawFraming). This should only
+ * be used if you are manually decoding. You will be forced to use a morse
+ * callsign if you use this method. You can of course change this if you
+ * want to, but please keep in mind that if you use your own encoding people
+ * will not be able to identify your station!
+ * 
+ * @param data 
+ * @param length Number of bytes
+ * @param framing See RawFraming
+ * @return true - Success, you can find the wav file at the file path specified
+ */
+bool PSK::encodeRawData(const unsigned char *data, int length,
+                        const RawFraming &framing) {
+    resetState();
+    buildRawBitStream(data, length, framing);
+    return encodeToFile();
+}
+
+/**
+ * @brief Encode raw data into PSK audio samples in memory. See
+ * encodeRawData(const unsigned char *, int, const RawFraming &) and
+ * encodeTextData(const std::string &, std::vector<int16_t> &).
+ * @param data 
+ * @param length Number of bytes
+ * @param out Vector that the 16 bit mono samples are appended to
+ * @param framing See RawFraming
+ * @return true - Success
+ */
+bool PSK::encodeRawData(const unsigned char *data, int length,
+                        std::vector<int16_t> &out, const RawFraming &framing) {
+    resetState();
+    buildRawBitStream(data, length, framing);
+    return encodeToVector(out);
+}
+
+/**
+ * @brief Encode raw data into PSK audio samples passed to a callback. See
+ * encodeRawData(const unsigned char *, int, const RawFraming &) and
+ * encodeTextData(const std::string &, SampleCallback).
+ * @param data 
+ * @param length Number of bytes
+ * @param callback Called with each block of 16 bit mono samples
+ * @param framing See RawFraming
+ * @return true - Success
+ */
+bool PSK::encodeRawData(const unsigned char *data, int length,
+                        SampleCallback callback, const RawFraming &framing) {
+    resetState();
+    buildRawBitStream(data, length, framing);
+    return encodeToCallback(callback);
+}
+
+/**
+ * @brief Encode raw data into PSK audio written to a stream. See
+ * encodeRawData(const unsigned char *, int, const RawFraming &) and
+ * encodeTextData(const std::string &, std::ostream &, bool).
+ * @param data 
+ * @param length Number of bytes
+ * @param out Stream to write to, opened in binary mode
+ * @param wav_header Write a wav header before the samples
+ * @param framing See RawFraming
+ * @return true - Success
+ * @return false - Failure, the stream is in a failed state
+ */
+bool PSK::encodeRawData(const unsigned char *data, int length, std::ostream &out,
+                        bool wav_header, const RawFraming &framing) {
+    resetState();
+    buildRawBitStream(data, length, framing);
+    return encodeToStream(out, wav_header);
+}
+
+/**
+ * @brief Starts a wav file at the file path that messages are appended to
+ * with appendTextData() until endTextData().
+ * @details The file gets one header, one preamble and one postamble (and
+ * the CW ID once at each end). Messages follow each other with only
+ * 'idle_length' idle symbols between them, and the modulator state carries on
+ * from one message to the next, so the carrier phase is continuous across
+ * the whole file. The audio is written as it is rendered and the RIFF sizes
+ * are set once by endTextData(). No other encode method can be used until
+ * then.
+ * 
+ * @param idle_length Idle symbols (0's) between two messages, at least 0
+ * @return true - Success
+ */
+bool PSK::beginTextData(int idle_length) {
+    if (idle_length < 0) {
+        throw std::invalid_argument("Idle length can not be negative");
+    }
+    resetState(); // Also rejects a transmission that is still in progress
+    if (morse_callsign_) {
+        callSignSamples(); // Rejects an invalid callsign before the file is created
+    }
+    if (!openFile(file_path_)) {
+        throw std::invalid_argument("Failed to open file at path: " + file_path_);
+    }
+    writeHeader();
+    if (morse_callsign_) {
+        addCallSign(true);
+    }
+    PSK_STATS_TIMER(bit_stream_seconds);
+    addPreamble();
+    appending_ = true;
+    append_idle_length_ = idle_length;
+    appended_messages_ = 0;
+    return true;
+}
+
+/**
+ * @brief Appends a message to the transmission started with beginTextData().
+ * @details The message is rendered and written before this returns, except
+ * for its last few symbols, whose pulse shape depends on what follows them.
+ * @param message 
+ * @return true - Success
+ */
+bool PSK::appendTextData(const std::string &message) {
+    if (!appending_) {
+        throw std::invalid_argument("No transmission in progress, call beginTextData() first");
+    }
+    {
+        PSK_STATS_TIMER(bit_stream_seconds);
+        if (appended_messages_ > 0) {
+            addIdle(append_idle_length_);
+        }
+        for (const char &c : message) {
+            addVaricode(c);
+        }
+    }
+    appended_messages_++;
 
-    //if (morse_callsign_) { // If callsign specified, add morse code callsign
-    //    if (call_sign_.length() < 4) {
-    //        throw std::invalid_argument("Callsign must be at least 4 characters");
-    //    }
-    //    addCallSign();
-    //}
+    // Every complete word but the last, its last symbol looks ahead into the next
+    size_t words = bit_stream_.empty() ? 0 : bit_stream_.size() - 1;
+    encodeBitStream(words);
+    bit_stream_.erase(bit_stream_.begin(), bit_stream_.begin() + words);
+    return true;
+}
+
+/**
+ * @brief Adds the postamble (and CW ID), renders what is left of the
+ * transmission and finalizes the wav file. See beginTextData().
+ * @return true - Success
+ */
+bool PSK::endTextData() {
+    if (!appending_) {
+        throw std::invalid_argument("No transmission in progress, call beginTextData() first");
+    }
+    {
+        PSK_STATS_TIMER(bit_stream_seconds);
+        addPostamble();
+        pushBufferToBitStream();
+    }
+    encodeBitStream();
+    if (morse_callsign_) {
+        addCallSign(false);
+    }
+    finalizeFile();
+    appending_ = false;
+    return true;
+}
+
+/**
+ * @brief Enables or disables the incremental re-encode cache (disabled by
+ * default). The output is identical either way.
+ * @details For transmissions that repeat a template with a few changing
+ * fields (beacons, telemetry). The audio of the last message is kept and the
+ * next message only renders the span of its bit stream that differs, see
+ * incremental_. While enabled, messages are encoded on the calling thread
+ * only (see setThreads()) and the audio passes through the cache, so there
+ * is one extra copy of every sample. The gain is largest when symbols are
+ * rendered directly (the template cache is disabled or too large), with
+ * templates rendering is already close to a copy. Disabling it frees the
+ * cache.
+ * @param enabled 
+ */
+void PSK::setIncremental(bool enabled) {
+    incremental_ = IncrementalCache();
+    incremental_.enabled = enabled;
+}
+
+/**
+ * @brief Enables or disables memory mapped wav output (enabled by default
+ * where mmap is available). The output is identical either way.
+ * @details The size of the file is known before modulation starts, so the
+ * file is preallocated, mapped, given a complete header and the samples are
+ * rendered straight into the mapping. This avoids the stream writes and the
+ * copy through the output buffer. If the file can not be mapped, it is
+ * written as a stream.
+ * @param enabled 
+ */
+void PSK::setMemoryMapped(bool enabled) {
+    memory_mapped_ = enabled;
+}
+
+/**
+ * @brief Enables or disables recording of stats(). Disabled by default, when
+ * disabled the instrumentation costs one branch per stage.
+ * @param enabled 
+ */
+void PSK::setStats(bool enabled) {
+#if PSK_STATS
+    stats_enabled_ = enabled;
+#else
+    (void) enabled;
+#endif
+}
+
+/**
+ * @brief Timing and counters accumulated since the last resetStats(), see
+ * PSK::Stats. All zero if the library was built with PSK_STATS=0.
+ */
+const PSK::Stats &PSK::stats() const {
+    return stats_;
+}
+
+/**
+ * @brief Clears stats().
+ */
+void PSK::resetStats() {
+    stats_ = Stats();
+}
+
+/**
+ * @brief Sets the path of the wav file written by the file based encode
+ * methods, so that one object can write many files.
+ * @param file_path 
+ */
+void PSK::setFilePath(std::string file_path) {
+    file_path_ = file_path;
+}
+
+/**
+ * @brief Sets the callsign that is sent in Morse code before and after every
+ * transmission. It is keyed once and reused until the callsign, sample rate
+ * or carrier settings change.
+ * @param call_sign At least 4 characters: A-Z, 0-9, space and / - . , ? =
+ * (lower case is sent as upper case). Empty to send no CW ID.
+ */
+void PSK::setCallSign(std::string call_sign) {
+    call_sign_ = call_sign;
+    morse_callsign_ = !call_sign.empty();
+    call_sign_samples_.clear();
+}
+
+/**
+ * @brief Sets how many samples are buffered before they are written to the
+ * wav file. Larger chunks mean fewer, larger writes.
+ * @param samples Chunk size in samples, must be at least 1
+ */
+void PSK::setOutputChunkSize(int samples) {
+    if (samples < 1) {
+        throw std::invalid_argument("Output chunk size must be at least 1");
+    }
+    flushSamples();
+    output_chunk_size_ = samples;
+}
+
+void PSK::dumpBitStream() {
+    std::cout << "Bitstream:" << std::endl;
+    for (int i = 0; i < bit_stream_.size(); i++) {
+        std::cout << "[" << i << "]" << std::bitset<32>(bit_stream_[i]) << std::endl;
+    }
+}
+
+/**
+ * @brief Clears the bit stream and modulator state. Buffers keep their
+ * capacity, so encoding the next message does not need to reallocate.
+ * @details The encode methods call this themselves, so it is only needed to
+ * drop state early.
+ */
+void PSK::reset() {
+    resetState();
+}
+
+/**
+ * @brief Returns the current configuration.
+ */
+const PSK::Config &PSK::config() const {
+    return config_;
+}
 
+// Private Methods
+
+/**
+ * @brief Clears the bit stream and modulator state so that a new message can
+ * be encoded with the same object.
+ */
+void PSK::resetState() {
+    if (appending_) {
+        throw std::invalid_argument("A transmission is in progress, call endTextData() first");
+    }
+    bit_stream_.clear();
+    bit_stream_buffer_ = 0;
+    bit_stream_offset_ = 0;
+    carrier_phase_ = 0;
+    symbol_clock_ = 0;
+    last_transition_ = 2; // Fade in from silence
+    encoder_ = EncoderState();
+    sample_buffer_fill_ = 0;
+}
+
+/**
+ * @brief Builds the bit stream for a text message: preamble, varicode with
+ * two 0's between each character, and postamble.
+ * @param message 
+ */
+void PSK::buildTextBitStream(const std::string &message) {
+    PSK_STATS_TIMER(bit_stream_seconds);
+    bit_stream_.reserve(textBitStreamWords(message));
     addPreamble(); // Add PSK Preamble to bitstream (0's)
-    for (char &c : message) {
-        addVaricode(c); // Add each char of the message to the bitstream (varicode)
-        static unsigned char zeros[1] = {0x00};
-        addBits(zeros, 2); // Add two 0's between each character
+    for (const char &c : message) {
+        addVaricode(c); // Add each char of the message to the bitstream (varicode + 00)
     }
     addPostamble(); // Add PSK Postamble to bitstream
     pushBufferToBitStream(); // Push any remaining bits in the buffer to the bitstream
+}
 
-    encodeBitStream(); // Encode the bitstream into PSK audio, write to wav file
+/**
+ * @brief Exact number of words buildTextBitStream() produces for 'message':
+ * the preamble, the varicode lengths (with separators) from the varicode
+ * table, padding to a whole word and the postamble.
+ * @param message 
+ */
+size_t PSK::textBitStreamWords(const std::string &message) const {
+    size_t bits = preamble_length_;
+    for (const char &c : message) {
+        bits += varicode_words.words[c & 0x7f].length;
+    }
+    bits = (bits + 31) / 32 * 32 + postamble_length_; // See addPostamble()
+    return (bits + 31) / 32;
+}
 
-    //if (morse_callsign_) { // If callsign specified, add morse code callsign to end of audio
-    //    addCallSign();
-    //}
+/**
+ * @brief Builds the bit stream for raw data: preamble, the optional length
+ * prefix, the bytes MSB first, the optional CRC and postamble.
+ * @details A callsign is required, see encodeRawData(). The bit stream is
+ * reserved for its exact length and the bytes go in a word at a time.
+ * @param data 
+ * @param length Number of bytes
+ * @param framing 
+ */
+void PSK::buildRawBitStream(const unsigned char *data, int length,
+                            const RawFraming &framing) {
+    if (!morse_callsign_) {
+        throw std::invalid_argument("Callsign required for raw data");
+    }
+    callSignSamples(); // Rejects an invalid callsign before any output
+    if (length < 0 || (length > 0 && data == nullptr)) {
+        throw std::invalid_argument("Invalid raw data");
+    }
+    if (framing.length_prefix && length > 0xFFFF) {
+        throw std::invalid_argument("Raw data with a length prefix must be at most 65535 bytes");
+    }
 
-    finalizeFile(); // Close wav file
-    return true;
+    PSK_STATS_TIMER(bit_stream_seconds);
+    size_t bits = preamble_length_ + (size_t) length * 8
+                  + (framing.length_prefix ? 16 : 0) + (framing.crc ? 16 : 0);
+    bits = (bits + 31) / 32 * 32 + postamble_length_; // See addPostamble()
+    bit_stream_.reserve((bits + 31) / 32);
+
+    addPreamble(); // Add PSK Preamble to bitstream (0's)
+    uint16_t crc = 0xFFFF;
+    if (framing.length_prefix) {
+        const unsigned char prefix[2] = {(unsigned char) (length >> 8),
+                                         (unsigned char) length};
+        crc = crc16(crc, prefix, 2);
+        appendBits((uint32_t) length, 16);
+    }
+    addBits(data, length * 8); // Add raw data to bitstream
+    if (framing.crc) {
+        appendBits(crc16(crc, data, length), 16);
+    }
+    addPostamble(); // Add PSK Postamble to bitstream
+    pushBufferToBitStream(); // Push any remaining bits in the buffer to the bitstream
+}
+
+/**
+ * @brief Number of samples that encodeBitStream() will produce for the current
+ * bit stream (one symbol per bit).
+ */
+long long PSK::bitStreamSampleCount() const {
+    return symbolClockSamples(symbol_clock_, (long long) bit_stream_.size() * 32);
+}
+
+/**
+ * @brief Changes the mode and symbol rate, keeping the current PSK::Config
+ * (the default one for a new object).
+ */
+void PSK::setup(Mode mode, SymbolRate symbol_rate) {
+    setup(mode, symbol_rate, config_);
 }
 
 /**
- * @brief Encode raw data into PSK audio.
- * @details Adds preamble and postamble to the audio, and callsign if specified.
- * Does *not* use varicode or convolutional code! This should only be used
- * if you are manually decoding. You will be forced to use a morse callsign
- * if you use this method. You can of course change this if you want to, but
- * please keep in mind that if you use your own encoding people will not
- * be able to identify your station!
+ * @brief Configures the modulator. Can be called again to change the mode,
+ * symbol rate or output settings of an existing object.
+ * @details Everything is validated before the object is changed, so a
+ * setup() that throws leaves the previous configuration in place.
  * 
- * @param data 
- * @param length 
- * @return true 
- * @return false - Failure, check the console for more information.
+ * @param mode BPSK or QPSK
+ * @param symbol_rate 
+ * @param config See PSK::Config
+ */
+void PSK::setup(Mode mode, SymbolRate symbol_rate, const Config &config) {
+    if (config.sample_rate <= 0 || config.sample_rate > max_sample_rate) {
+        throw std::invalid_argument("Sample rate must be between 1 and "
+                                    + std::to_string(max_sample_rate) + " Hz");
+    }
+    if (config.bits_per_sample != 16) {
+        throw std::invalid_argument("Only 16 bits per sample is supported");
+    }
+    if (config.sample_format < PCM16 || config.sample_format > IMA_ADPCM) {
+        throw std::invalid_argument("Invalid sample format");
+    }
+    if (config.carrier_freq <= 0 || config.carrier_freq * 2 >= config.sample_rate) {
+        throw std::invalid_argument("Carrier frequency must be between 0 and half the sample rate");
+    }
+    if (config.preamble_length < 0 || config.postamble_length < 0) {
+        throw std::invalid_argument("Preamble and postamble length can not be negative");
+    }
+
+    switch (mode) {
+        case BPSK:
+            break;
+        case QPSK:
+            break;
+        default:
+            throw std::invalid_argument("Invalid mode");
+            break;
+    }
+
+    double rate;
+    switch (symbol_rate) {
+        case S31:
+            rate = 31.25;
+            break;
+        case S63:
+            rate = 62.5;
+            break;
+        case S125:
+            rate = 125.0;
+            break;
+        case S250:
+            rate = 250.0;
+            break;
+        case S500:
+            rate = 500.0;
+            break;
+        case S1000:
+            rate = 1000.0;
+            break;
+        default:
+            throw std::invalid_argument("Invalid symbol rate");
+            break;
+    }
+
+    const int clock_modulus = std::lround(rate * 4);
+    const int samples_per_symbol = (4LL * config.sample_rate) / clock_modulus;
+    if (samples_per_symbol < 2) {
+        throw std::invalid_argument("Sample rate is too low for the symbol rate");
+    }
+
+    config_ = config;
+    sample_rate_ = config_.sample_rate;
+    bits_per_sample_ = config_.bits_per_sample;
+    max_amplitude_ = pow(2, bits_per_sample_ - 1) - 1;
+    carrier_freq_ = config_.carrier_freq;
+    preamble_length_ = config_.preamble_length;
+    postamble_length_ = config_.postamble_length;
+    mode_ = mode;
+    symbol_rate_ = rate;
+
+    angle_delta_ = 2.0 * M_PI * ( (double) carrier_freq_ / (double) sample_rate_ );
+    symbol_clock_modulus_ = clock_modulus;
+    samples_per_symbol_ = samples_per_symbol;
+    symbol_clock_fraction_ = (4LL * sample_rate_) % symbol_clock_modulus_;
+    symbol_clock_ = 0;
+    carrier_period_ = sample_rate_ / std::gcd(sample_rate_, carrier_freq_);
+    carrier_phase_ = 0;
+
+    modulator_ = mode_ == BPSK ? selectModulator<BPSK>(samples_per_symbol_)
+                               : selectModulator<QPSK>(samples_per_symbol_);
+
+    // Pulse tables for both symbol lengths, see pulseTableOffset()
+    phase_step_ = (((uint64_t) carrier_freq_ << 32) + sample_rate_ / 2) / sample_rate_;
+    const int table_size = 2 * samples_per_symbol_ + 1;
+    filter_shape_q15_.resize(table_size);
+    pulse_.resize(table_size);
+    pulse_overlap_.resize(table_size);
+    pulse_q15_.resize(table_size);
+    envelope_.resize(4 * table_size);
+    const double amplitude = .5;
+    for (int length = samples_per_symbol_; length <= samples_per_symbol_ + 1; length++) {
+        const int offset = pulseTableOffset(length);
+        int time = 0 - (length / 2);
+        for (int i = 0; i < length; i++, time++) {
+            // Fixed point renderer: pulse shape cos(|t| / sps * roll_off)^2 in Q15
+            filter_shape_q15_[offset + i] = filterShapeQ15(time, length);
+
+            // Raised cosine pulse: cos^2(pi * t / 2T), two symbols (T) long. The
+            // neighbouring pulse overlapping this symbol is 1 - pulse.
+            double cosine = std::cos(M_PI * std::abs(time) / (2.0 * length));
+            pulse_[offset + i] = cosine * cosine;
+            pulse_overlap_[offset + i] = 1.0 - pulse_[offset + i];
+            pulse_q15_[offset + i] = pulseQ15(time, length);
+
+            // Vectorized renderer envelopes, same pulse shape as renderSymbolFloat()
+            double filter = std::pow(std::cos( (std::abs(time) / (double) length) * 2.9 ), 2.0);
+            for (int filtering = 0; filtering < 4; filtering++) {
+                int filter_start = filtering >> 1;
+                int filter_end = filtering & 1;
+                bool unfiltered = (!filter_start && time < 0) || (!filter_end && time > 0);
+                envelope_[4 * offset + filtering * length + i] =
+                    amplitude * (unfiltered ? 1.0 : filter) * max_amplitude_;
+            }
+        }
+    }
+
+    clearSymbolTemplates();
+    call_sign_samples_.clear(); // Keyed at the old sample rate
+}
+
+/**
+ * @brief Enables or disables the vectorized renderer for symbols that are not
+ * served from the symbol template cache. Enabled by default.
+ * @param enabled 
+ */
+void PSK::setVectorized(bool enabled) {
+    vectorized_ = enabled;
+    incremental_.valid = false;
+}
+
+/**
+ * @brief Enables or disables the symbol template cache (enabled by default).
+ * With it disabled every symbol is rendered directly, which uses less memory.
+ * @param enabled 
+ */
+void PSK::setSymbolTemplates(bool enabled) {
+    if (use_symbol_templates_ != enabled) {
+        use_symbol_templates_ = enabled;
+        clearSymbolTemplates();
+    }
+}
+
+/**
+ * @brief Selects the pulse shape. Clears the symbol template cache.
+ * @details ENVELOPE (default) is the original cos^2 envelope that is switched
+ * on at the side of each phase change. RAISED_COSINE filters the baseband
+ * symbols with a two symbol long raised cosine pulse, which gives a narrower
+ * spectrum and also shapes the 90 degree QPSK shifts correctly.
+ * @param shape 
+ */
+void PSK::setPulseShape(PulseShape shape) {
+    if (pulse_shape_ != shape) {
+        pulse_shape_ = shape;
+        clearSymbolTemplates();
+    }
+}
+
+/**
+ * @brief Enables or disables the fixed point (integer only) renderer.
+ * @details The fixed point renderer is bit exact on every platform and does
+ * not need an FPU. Its output differs slightly from the floating point
+ * renderer. Clears the symbol template cache.
+ * @param enabled 
+ */
+void PSK::setFixedPoint(bool enabled) {
+    if (fixed_point_ != enabled) {
+        fixed_point_ = enabled;
+        clearSymbolTemplates();
+    }
+}
+
+/**
+ * @brief Clears the symbol template caches (including the per worker caches)
+ * after a configuration change.
+ */
+void PSK::clearSymbolTemplates() {
+    resetSymbolTemplates(symbol_templates_);
+    for (SymbolTemplates &templates : worker_templates_) {
+        resetSymbolTemplates(templates);
+    }
+    incremental_.valid = false; // Rendered with the old settings too
+}
+
+/**
+ * @brief Number of distinct start/end transition pairs a symbol template is
+ * keyed on. The envelope only sees filtered or unfiltered (2 x 2), the raised
+ * cosine pulse sees every quarter turn shift (4 x 4).
+ */
+int PSK::transitionKeyCount() const {
+    return pulse_shape_ == RAISED_COSINE ? 16 : 4;
+}
+
+/**
+ * @brief Number of distinct symbol lengths, 1 if the symbol rate divides the
+ * sample rate, otherwise 2 (samples_per_symbol_ and one sample more).
+ */
+int PSK::symbolLengthCount() const {
+    return symbol_clock_fraction_ == 0 ? 1 : 2;
+}
+
+/**
+ * @brief Start of the pulse tables of a symbol 'length' samples long, in
+ * samples (multiply by 4 for envelope_).
+ */
+int PSK::pulseTableOffset(int length) const {
+    return length == samples_per_symbol_ ? 0 : samples_per_symbol_;
+}
+
+/**
+ * @brief Advances a symbol clock by one symbol.
+ * @param clock Symbol clock, see symbol_clock_
+ * @return int Length of the symbol in samples
+ */
+int PSK::nextSymbolLength(int &clock) const {
+    clock += symbol_clock_fraction_;
+    if (clock >= symbol_clock_modulus_) {
+        clock -= symbol_clock_modulus_;
+        return samples_per_symbol_ + 1;
+    }
+    return samples_per_symbol_;
+}
+
+/**
+ * @brief Number of samples in the next 'symbols' symbols of a symbol clock.
+ */
+long long PSK::symbolClockSamples(int clock, long long symbols) const {
+    return symbols * samples_per_symbol_
+           + (clock + symbols * symbol_clock_fraction_) / symbol_clock_modulus_;
+}
+
+/**
+ * @brief A symbol clock after advancing it by 'symbols' symbols.
+ */
+int PSK::symbolClockAfter(int clock, long long symbols) const {
+    return (clock + symbols * symbol_clock_fraction_) % symbol_clock_modulus_;
+}
+
+/**
+ * @brief Empties a template cache and sizes its index for the current
+ * configuration, or disables it if it could grow too large.
+ * @param templates 
+ */
+void PSK::resetSymbolTemplates(SymbolTemplates &templates) const {
+    // 4 phase shifts x the transitions at the start and end x the lengths
+    long long template_count = (long long) carrier_period_ * 4 * transitionKeyCount()
+                               * symbolLengthCount();
+    templates.enabled = use_symbol_templates_ &&
+        template_count * (samples_per_symbol_ + 1) <= symbol_template_limit_;
+    templates.samples.clear();
+    templates.index.clear();
+    if (templates.enabled) {
+        templates.index.assign(template_count, -1);
+    }
+}
+
+/**
+ * @brief Opens the wav file and writes the header.
+ * @param file_path 
+ * @return true - Success
+ * @return false - Failure
+ */
+bool PSK::openFile(std::string file_path) {
+    PSK_STATS_TIMER(io_seconds);
+    wav_file_.open(file_path, std::ios::binary);
+    if (wav_file_.is_open()) {
+        return true;
+    } else {
+        return false;
+    }
+}
+
+/**
+ * @brief Writes the header to the wav file, this happens before audio data.
+ * @details This method will save the location of the 'data size' field in
+ * the header so that it can be updated later after adding data.
+ */
+void PSK::writeHeader() {
+    writeHeader(sample_rate_, 1);
+}
+
+/**
+ * @brief Writes a wav header for 'channels' interleaved channels at
+ * 'sample_rate'. See writeHeader(). Mono files use Config::sample_format,
+ * others are 16 bit PCM.
+ */
+void PSK::writeHeader(int sample_rate, int channels) {
+    PSK_STATS_TIMER(io_seconds);
+    startFormattedOutput(channels == 1 ? config_.sample_format : PCM16);
+    writeHeader(wav_file_, sample_rate, channels, 0, output_format_, 0);
+    PSK_STATS_ADD(bytes_written, wavHeaderSize(output_format_));
+
+    // Save the location of the data size field so that it can be updated later
+    data_start_ = wav_file_.tellp();
+}
+
+/**
+ * @brief Writes a wav header to any stream.
+ * @param out 
+ * @param sample_rate 
+ * @param channels 
+ * @param data_size Size of the data chunk in bytes, 0xFFFFFFFF if unknown
+ * @param format 
+ * @param frames Samples per channel for the fact chunk of FLOAT32 and
+ * IMA_ADPCM, 0xFFFFFFFF if unknown
+ */
+void PSK::writeHeader(std::ostream &out, int sample_rate, int channels,
+                      uint32_t data_size, SampleFormat format,
+                      uint32_t frames) const {
+    char header[max_wav_header_size_];
+    int size = formatHeader(header, sample_rate, channels, data_size, format, frames);
+    out.write(header, size);
+}
+
+/**
+ * @brief Size of the wav header for 'format' in bytes: 44 for PCM, 58 for
+ * FLOAT32 and 60 for IMA_ADPCM (longer fmt chunk and a fact chunk).
+ */
+int PSK::wavHeaderSize(SampleFormat format) {
+    switch (format) {
+        case FLOAT32: return 12 + 8 + 18 + 12 + 8;
+        case IMA_ADPCM: return 12 + 8 + 20 + 12 + 8;
+        default: return 12 + 8 + 16 + 8;
+    }
+}
+
+/**
+ * @brief Formats a wav header into wavHeaderSize() bytes of memory. See
+ * writeHeader(std::ostream &, int, int, uint32_t, SampleFormat, uint32_t).
+ * @return int Size of the header in bytes
+ */
+int PSK::formatHeader(char *header, int sample_rate, int channels,
+                      uint32_t data_size, SampleFormat format,
+                      uint32_t frames) const {
+    char *start = header;
+    auto put = [&header](uint32_t data, int size) { // Little endian
+        for (int i = 0; i < size; i++) {
+            *header++ = (char) (data >> (8 * i));
+        }
+    };
+    auto tag = [&header](const char *name) {
+        std::memcpy(header, name, 4);
+        header += 4;
+    };
+    int compression = 1; // PCM
+    int bits = 16;
+    int block_align = channels * 2;
+    uint32_t byte_rate = sample_rate * block_align;
+    int fmt_size = 16;
+    if (format == PCM8) {
+        bits = 8;
+        block_align = channels;
+        byte_rate = sample_rate * block_align;
+    } else if (format == FLOAT32) {
+        compression = 3; // IEEE float
+        bits = 32;
+        block_align = channels * 4;
+        byte_rate = sample_rate * block_align;
+        fmt_size = 18;
+    } else if (format == IMA_ADPCM) {
+        compression = 0x11;
+        bits = 4;
+        block_align = channels * ImaAdpcmEncoder::block_align;
+        byte_rate = (uint64_t) sample_rate * block_align / ImaAdpcmEncoder::samples_per_block;
+        fmt_size = 20;
+    }
+    int header_size = wavHeaderSize(format);
+    uint32_t riff_size = data_size > 0xFFFFFFFF - (header_size - 8)
+                       ? 0xFFFFFFFF : data_size + (header_size - 8);
+    tag("RIFF"); // RIFF header
+    put(riff_size, 4);
+    tag("WAVE");
+    tag("fmt "); // format
+    put(fmt_size, 4); // size
+    put(compression, 2); // compression code
+    put(channels, 2); // number of channels
+    put(sample_rate, 4); // sample rate
+    put(byte_rate, 4); // Byte rate
+    put(block_align, 2); // block align
+    put(bits, 2); // bits per sample
+    if (format == FLOAT32) {
+        put(0, 2); // no extension
+    } else if (format == IMA_ADPCM) {
+        put(2, 2); // extension size
+        put(ImaAdpcmEncoder::samples_per_block, 2);
+    }
+    if (format == FLOAT32 || format == IMA_ADPCM) {
+        tag("fact"); // samples per channel, required for non PCM formats
+        put(4, 4);
+        put(frames, 4);
+    }
+    tag("data"); // data section follows this
+    put(data_size, 4);
+    return (int) (header - start);
+}
+
+/**
+ * @brief Writes the audio data to the wav file.
+ * @param data - int of data to write to wav file
+ * @param num_bytes - number of bytes to write
+ */
+void PSK::writeBytes(int data, int size) {
+    writeBytes(wav_file_, data, size);
+}
+
+/**
+ * @brief Writes the low 'size' bytes of 'data' (little endian) to a stream.
+ */
+void PSK::writeBytes(std::ostream &out, uint32_t data, int size) {
+    out.write(reinterpret_cast<const char*> (&data), size);
+}
+
+/**
+ * @brief Updates the 'data segment size' field in the wav header and closes
+ * the file.
+ */
+void PSK::finalizeFile() {
+    flushSamples(); // Write any samples still in the buffer
+    [[maybe_unused]] long long tail = finishFormattedOutput(wav_file_);
+    PSK_STATS_TIMER(io_seconds);
+    PSK_STATS_ADD(bytes_written, tail);
+    int data_end_ = wav_file_.tellp(); // Save the position of the end of the 
+                                       // data chunk
+    int data_size = data_end_ - data_start_;
+    if (data_size & 1) { // Chunks are padded to an even size (8 bit samples)
+        writeBytes(0, 1);
+        PSK_STATS_ADD(bytes_written, 1);
+    }
+    int file_end = wav_file_.tellp();
+    wav_file_.seekp(data_start_ - 4); // Go to the beginning of the data chunk
+    writeBytes(data_size, 4); // and write the size of the chunk.
+    if (output_format_ == FLOAT32 || output_format_ == IMA_ADPCM) {
+        uint32_t frames = output_format_ == FLOAT32 ? data_size / 4
+                                                    : (uint32_t) adpcm_encoder_->samples();
+        wav_file_.seekp(data_start_ - 12); // Sample count of the fact chunk
+        writeBytes(frames, 4);
+    }
+    wav_file_.seekp(4, std::ios::beg); // Go to the beginning of the file
+    writeBytes(file_end - 8, 4); // Write the size of the overall file
+    wav_file_.close();
+    output_format_ = PCM16;
+}
+
+/**
+ * @brief Selects the format of the wav file or stream that is about to be
+ * written and resets the IMA ADPCM encoder.
+ */
+void PSK::startFormattedOutput(SampleFormat format) {
+    output_format_ = format;
+    if (format == IMA_ADPCM) {
+        if (!adpcm_encoder_) {
+            adpcm_encoder_.reset(new ImaAdpcmEncoder());
+        }
+        adpcm_encoder_->reset();
+    }
+}
+
+/**
+ * @brief Converts 'count' samples to output_format_ and writes them to 'out'.
+ * @return long long Number of bytes written
  */
-bool PSK::encodeRawData(unsigned char *data, int length) {
+long long PSK::writeFormatted(std::ostream &out, const int16_t *samples, int count) {
+    const char *bytes = reinterpret_cast<const char*> (samples);
+    size_t size = count * sizeof(int16_t);
+    switch (output_format_) {
+        case PCM16:
+            break;
+        case PCM8:
+            format_buffer_.resize(count);
+            convertPcm8(format_buffer_.data(), samples, count);
+            bytes = reinterpret_cast<const char*> (format_buffer_.data());
+            size = count;
+            break;
+        case FLOAT32:
+            format_buffer_.resize(count * sizeof(float));
+            convertFloat32(reinterpret_cast<float*> (format_buffer_.data()), samples, count);
+            bytes = reinterpret_cast<const char*> (format_buffer_.data());
+            size = count * sizeof(float);
+            break;
+        case IMA_ADPCM:
+            format_buffer_.clear();
+            adpcm_encoder_->encode(samples, count, format_buffer_);
+            bytes = reinterpret_cast<const char*> (format_buffer_.data());
+            size = format_buffer_.size();
+            break;
+    }
+    out.write(bytes, size);
+    return size;
+}
+
+/**
+ * @brief Writes what the format still holds (the last IMA ADPCM block) once
+ * all samples have been flushed.
+ * @return long long Number of bytes written
+ */
+long long PSK::finishFormattedOutput(std::ostream &out) {
+    if (output_format_ != IMA_ADPCM) {
+        return 0;
+    }
+    format_buffer_.clear();
+    adpcm_encoder_->finish(format_buffer_);
+    out.write(reinterpret_cast<const char*> (format_buffer_.data()), format_buffer_.size());
+    return format_buffer_.size();
+}
+
+/**
+ * @brief Encodes the bit stream (and CW ID) to the wav file at file_path_,
+ * memory mapped if enabled, see setMemoryMapped().
+ */
+bool PSK::encodeToFile() {
+    if (memory_mapped_ && encodeToMappedFile()) {
+        return true;
+    } // Could not map the file, write it as a stream instead
     if (!openFile(file_path_)) { // Open Wav File at Path
         throw std::invalid_argument("Failed to open file at path: " + file_path_);
     } else {
         writeHeader(); // Write Wav Header on success
     }
 
-    if (!morse_callsign_) { // If callsign specified, add morse code callsign
-        throw std::invalid_argument("Callsign required for raw data");
+    encodeTransmission(); // Encode the bitstream into PSK audio, write to wav file
+
+    finalizeFile(); // Close wav file
+    return true;
+}
+
+/**
+ * @brief Saves the output target with its sample vector, callback, stream
+ * and format, and restores them when it goes out of scope, so an encode
+ * that throws does not leave the encoder writing to a sink that is gone.
+ */
+class PSK::OutputGuard {
+    public:
+        explicit OutputGuard(PSK &psk)
+            : psk_(psk), output_target_(psk.output_target_),
+              sample_vector_(psk.sample_vector_),
+              sample_callback_(psk.sample_callback_),
+              output_stream_(psk.output_stream_),
+              output_format_(psk.output_format_) {}
+
+        ~OutputGuard() {
+            psk_.output_target_ = output_target_;
+            psk_.sample_vector_ = sample_vector_;
+            psk_.sample_callback_ = sample_callback_;
+            psk_.output_stream_ = output_stream_;
+            psk_.output_format_ = output_format_;
+        }
+
+        OutputGuard(const OutputGuard &) = delete;
+        OutputGuard &operator=(const OutputGuard &) = delete;
+
+    private:
+        PSK &psk_;
+        OutputTarget output_target_;
+        std::vector<int16_t> *sample_vector_;
+        SampleCallback sample_callback_;
+        std::ostream *output_stream_;
+        SampleFormat output_format_;
+};
+
+/**
+ * @brief Encodes the bit stream (and CW ID) straight into 'out'.
+ */
+bool PSK::encodeToVector(std::vector<int16_t> &out) {
+    out.reserve(out.size() + transmissionSampleCount());
+    OutputGuard guard(*this);
+    output_target_ = SAMPLE_VECTOR;
+    sample_vector_ = &out;
+    encodeTransmission();
+    return true;
+}
+
+/**
+ * @brief Encodes the bit stream (and CW ID) to 'callback' in output chunks.
+ */
+bool PSK::encodeToCallback(SampleCallback callback) {
+    if (morse_callsign_) {
+        callSignSamples(); // Rejects an invalid callsign before any output
     }
-    if (call_sign_.length() < 4) {
-        throw std::invalid_argument("Callsign must be at least 4 characters");
+    OutputGuard guard(*this);
+    output_target_ = SAMPLE_CALLBACK;
+    sample_callback_ = callback;
+    encodeTransmission();
+    flushSamples();
+    return true;
+}
+
+/**
+ * @brief Encodes the bit stream (and CW ID) to 'out', after a streaming style
+ * wav header if 'wav_header' is set.
+ */
+bool PSK::encodeToStream(std::ostream &out, bool wav_header) {
+    if (morse_callsign_) {
+        callSignSamples(); // Rejects an invalid callsign before the header
+    }
+    OutputGuard guard(*this);
+    startFormattedOutput(config_.sample_format);
+    if (wav_header) {
+        PSK_STATS_TIMER(io_seconds);
+        writeHeader(out, sample_rate_, 1, 0xFFFFFFFF, output_format_, 0xFFFFFFFF);
+        PSK_STATS_ADD(bytes_written, wavHeaderSize(output_format_));
     }
 
-    addCallSign();
+    output_target_ = OUTPUT_STREAM;
+    output_stream_ = &out;
+    encodeTransmission();
+    flushSamples();
+    {
+        PSK_STATS_TIMER(io_seconds);
+        [[maybe_unused]] long long tail = finishFormattedOutput(out);
+        PSK_STATS_ADD(bytes_written, tail);
+        out.flush();
+    }
+    return out.good();
+}
 
-    addPreamble(); // Add PSK Preamble to bitstream
-    //addBits(data, length*8); // Add raw data to bitstream
-    addPostamble(); // Add PSK Postamble to bitstream
-    encodeBitStream(); // Encode the bitstream into PSK audio, write to wav file
+/**
+ * @brief Encodes the bit stream into a preallocated, memory mapped wav file
+ * at file_path_. See setMemoryMapped().
+ * @return false - mmap is not available or the file could not be mapped,
+ * nothing was encoded
+ */
+bool PSK::encodeToMappedFile() {
+#ifdef PSK_HAVE_MMAP
+    if (config_.sample_format != PCM16) { // Samples are rendered in place as 16 bit
+        return false;
+    }
+    const size_t header_size = wavHeaderSize(PCM16);
+    const long long data_size = transmissionSampleCount() * (long long) sizeof(int16_t);
+    if (data_size > 0xFFFFFFFFLL - 36) { // Too large for a wav file
+        return false;
+    }
+    const size_t file_size = header_size + data_size;
 
-    addCallSign();
+    /**
+     * @brief Unmaps and closes the file and detaches it from the encoder
+     * on every exit, also if encoding throws.
+     */
+    struct MappedFile {
+        PSK &psk;
+        int fd = -1;
+        void *map = MAP_FAILED;
+        size_t size = 0;
 
-    finalizeFile(); // Close wav file
+        explicit MappedFile(PSK &psk) : psk(psk) {}
+        ~MappedFile() {
+            psk.mapped_samples_ = nullptr;
+            psk.mapped_capacity_ = 0;
+            psk.mapped_fill_ = 0;
+            if (map != MAP_FAILED) {
+                munmap(map, size);
+            }
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    } file(*this);
+
+    {
+        PSK_STATS_TIMER(io_seconds);
+        file.fd = open(file_path_.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (file.fd < 0) {
+            throw std::invalid_argument("Failed to open file at path: " + file_path_);
+        }
+        if (ftruncate(file.fd, file_size) != 0) {
+            return false;
+        }
+        file.map = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, file.fd, 0);
+        if (file.map == MAP_FAILED) {
+            return false;
+        }
+        file.size = file_size;
+
+        formatHeader(static_cast<char*> (file.map), sample_rate_, 1, (uint32_t) data_size,
+                     PCM16, 0);
+    }
+
+    {
+        OutputGuard guard(*this);
+        output_target_ = MAPPED_FILE;
+        mapped_samples_ = reinterpret_cast<int16_t*> (static_cast<char*> (file.map) + header_size);
+        mapped_capacity_ = data_size / sizeof(int16_t);
+        mapped_fill_ = 0;
+        encodeTransmission();
+        if (mapped_fill_ != mapped_capacity_) {
+            throw std::length_error("Mapped wav file was not filled");
+        }
+    }
+
+    PSK_STATS_TIMER(io_seconds);
+    munmap(file.map, file_size);
+    file.map = MAP_FAILED;
+    close(file.fd);
+    file.fd = -1;
+    PSK_STATS_ADD(bytes_written, (long long) file_size);
     return true;
+#else
+    return false;
+#endif
 }
 
-void PSK::dumpBitStream() {
-    std::cout << "Bitstream:" << std::endl;
-    for (int i = 0; i < bit_stream_.size(); i++) {
-        std::cout << "[" << i << "]" << std::bitset<32>(bit_stream_[i]) << std::endl;
+/**
+ * @brief Returns a pointer to space for 'count' samples in the output buffer.
+ * The buffer is flushed to the wav file first if the samples would not fit.
+ * The samples must be committed with commitSamples() once written.
+ * @param count Number of samples to reserve
+ * @return int16_t* Pointer to the reserved samples
+ */
+int16_t *PSK::reserveSamples(int count) {
+    if (output_target_ == SAMPLE_VECTOR) { // Render directly into the vector
+        size_t size = sample_vector_->size();
+        sample_vector_->resize(size + count);
+        return sample_vector_->data() + size;
+    }
+    if (output_target_ == MAPPED_FILE) { // Render directly into the mapping
+        if (mapped_fill_ + count > mapped_capacity_) {
+            throw std::length_error("Mapped wav file is full");
+        }
+        return mapped_samples_ + mapped_fill_;
+    }
+    if (sample_buffer_fill_ + count > output_chunk_size_) {
+        flushSamples();
+    }
+    int required = std::max(output_chunk_size_, count);
+    if ((int) sample_buffer_.size() < required) {
+        sample_buffer_.resize(required);
+    }
+    return &sample_buffer_[sample_buffer_fill_];
+}
+
+/**
+ * @brief Marks 'count' reserved samples as written. Flushes the buffer when
+ * it is full.
+ * @param count Number of samples written since the last reserveSamples()
+ */
+void PSK::commitSamples(int count) {
+    if (output_target_ == SAMPLE_VECTOR) {
+        return;
+    }
+    if (output_target_ == MAPPED_FILE) {
+        mapped_fill_ += count;
+        return;
+    }
+    sample_buffer_fill_ += count;
+    if (sample_buffer_fill_ >= output_chunk_size_) {
+        flushSamples();
     }
 }
 
-// Private Methods
+/**
+ * @brief Writes all buffered samples to the wav file or sample callback.
+ */
+void PSK::flushSamples() {
+    if (sample_buffer_fill_ > 0) {
+        PSK_STATS_TIMER(io_seconds);
+        [[maybe_unused]] long long bytes;
+        if (output_target_ == SAMPLE_CALLBACK) {
+            sample_callback_(sample_buffer_.data(), sample_buffer_fill_);
+            bytes = sample_buffer_fill_ * (long long) sizeof(int16_t);
+        } else if (output_target_ == OUTPUT_STREAM) {
+            bytes = writeFormatted(*output_stream_, sample_buffer_.data(), sample_buffer_fill_);
+            output_stream_->flush();
+        } else {
+            bytes = writeFormatted(wav_file_, sample_buffer_.data(), sample_buffer_fill_);
+        }
+        PSK_STATS_ADD(bytes_written, bytes);
+        sample_buffer_fill_ = 0;
+    }
+}
 
-void PSK::setup(Mode mode, SymbolRate symbol_rate) {
-    mode_ = mode;
-    switch (mode) {
-        case BPSK:
-            break;
-        case QPSK:
-            break;
-        default:
-            throw std::invalid_argument("Invalid mode");
-            break;
+/**
+ * @brief Returns the keyed CW ID (see call_sign_samples_), keying it first if
+ * it is not cached.
+ */
+const std::vector<int16_t> &PSK::callSignSamples() {
+    if (call_sign_samples_.empty()) {
+        renderCallSign();
     }
+    return call_sign_samples_;
+}
 
-    switch (symbol_rate) {
-        case S31:
-            symbol_rate_ = 31.5;
-            break;
-        case S63:
-            symbol_rate_ = 63.5;
-            break;
-        case S125:
-            symbol_rate_ = 125.0;
-            break;
-        case S250:
-            symbol_rate_ = 250.0;
-            break;
-        case S500:
-            symbol_rate_ = 500.0;
-            break;
-        case S1000:
-            symbol_rate_ = 1000.0;
-            break;
-        default:
-            throw std::invalid_argument("Invalid symbol rate");
-            break;
+/**
+ * @brief Keys call_sign_ into call_sign_samples_ at morse_frequency_.
+ * @details Dits and dahs are morse_dit_length_ and morse_dah_length_ long,
+ * separated by one dit of silence within a character, three between
+ * characters and seven between words. Every element is shaped with a raised
+ * cosine rise and fall of morse_rise_time_ to avoid key clicks. The tone uses
+ * the fixed point carrier and sine table at the same amplitude as the PSK
+ * audio, so the CW ID is identical on every platform.
+ */
+void PSK::renderCallSign() {
+    if (call_sign_.length() < 4) {
+        throw std::invalid_argument("Callsign must be at least 4 characters");
     }
+    const int dit = (int) ((long long) sample_rate_ * morse_dit_length_ / 1000);
+    const int dah = (int) ((long long) sample_rate_ * morse_dah_length_ / 1000);
+    const int rise = std::max(1, (int) ((long long) sample_rate_ * morse_rise_time_ / 1000));
+    const uint32_t step = (((uint64_t) morse_frequency_ << 32) + sample_rate_ / 2) / sample_rate_;
+    const int32_t unity = 1 << 15;
 
-    angle_delta_ = 2.0 * M_PI * ( (double) carrier_freq_ / (double) sample_rate_ );
-    samples_per_symbol_ = std::floor(sample_rate_ / symbol_rate_);
+    std::vector<int16_t> &out = call_sign_samples_;
+    out.clear();
+    uint32_t nco = 0; // The tone is continuous across the gaps
+    auto silence = [&](int length) {
+        out.insert(out.end(), length, 0);
+        nco += (uint32_t) length * step;
+    };
+    auto tone = [&](int length) {
+        for (int i = 0; i < length; i++, nco += step) {
+            int edge = std::min(i, length - 1 - i);
+            int32_t envelope = unity;
+            if (edge < rise) { // sin^2 over the rise time, half a sample in
+                int32_t sine = sineQ15((uint32_t) (((uint64_t) (2 * edge + 1) << 29) / rise));
+                envelope = (sine * sine + (1 << 14)) >> 15;
+            }
+            out.push_back((int16_t) ((envelope * sineQ15(nco)) / (2 * unity)));
+        }
+    };
+
+    int gap = 0; // Silence before the next element
+    bool first = true;
+    for (char c : call_sign_) {
+        if (c == ' ') {
+            gap = first ? 0 : 7 * dit;
+            continue;
+        }
+        unsigned char character = std::toupper((unsigned char) c);
+        uint8_t code = character < 128 ? morse_code.codes[character] : 0;
+        if (code == 0) {
+            throw std::invalid_argument(std::string("Callsign character has no Morse code: ") + c);
+        }
+        gap = first ? 0 : std::max(gap, 3 * dit);
+        int elements = 7;
+        while (!(code >> elements)) { // Find the leading 1 bit
+            elements--;
+        }
+        for (int i = elements - 1; i >= 0; i--) {
+            silence(gap);
+            tone((code >> i) & 1 ? dah : dit);
+            gap = dit;
+        }
+        first = false;
+    }
+    call_sign_gap_ = 7 * dit;
+    silence(call_sign_gap_);
 }
 
 /**
- * @brief Opens the wav file and writes the header.
- * @param file_path 
- * @return true - Success
- * @return false - Failure
+ * @brief Writes the cached CW ID to the output.
+ * @param leading true before the PSK body (callsign, then a word space),
+ * false after it (a word space, then the callsign)
  */
-bool PSK::openFile(std::string file_path) {
-    wav_file_.open(file_path, std::ios::binary);
-    if (wav_file_.is_open()) {
-        return true;
+void PSK::addCallSign(bool leading) {
+    const std::vector<int16_t> &samples = callSignSamples();
+    const long long keyed = (long long) samples.size() - call_sign_gap_;
+    if (leading) {
+        writeSamples(samples.data(), samples.size());
     } else {
-        return false;
+        writeSamples(samples.data() + keyed, call_sign_gap_);
+        writeSamples(samples.data(), keyed);
     }
+    PSK_STATS_ADD(samples, (long long) samples.size());
 }
 
 /**
- * @brief Writes the header to the wav file, this happens before audio data.
- * @details This method will save the location of the 'data size' field in
- * the header so that it can be updated later after adding data.
+ * @brief Encodes the bit stream with encodeBitStream(), between two CW IDs if
+ * a callsign is set.
  */
-void PSK::writeHeader() {
-    wav_file_ << "RIFF****WAVE"; // RIFF header
-    wav_file_ << "fmt "; // format
-    writeBytes(16, 4); // size
-    writeBytes(1, 2); // compression code
-    writeBytes(1, 2); // number of channels
-    writeBytes(sample_rate_, 4); // sample rate
-    writeBytes(sample_rate_ * bits_per_sample_ / 8, 4 ); // Byte rate
-    writeBytes(bits_per_sample_ / 8, 2); // block align
-    writeBytes(bits_per_sample_, 2); // bits per sample
-    wav_file_ << "data****"; // data section follows this
-
-    // Save the location of the data size field so that it can be updated later
-    data_start_ = wav_file_.tellp();
+void PSK::encodeTransmission() {
+    if (morse_callsign_) {
+        addCallSign(true);
+    }
+    encodeBitStream();
+    if (morse_callsign_) {
+        addCallSign(false);
+    }
 }
 
 /**
- * @brief Writes the audio data to the wav file.
- * @param data - int of data to write to wav file
- * @param num_bytes - number of bytes to write
+ * @brief Number of samples that encodeTransmission() will produce for the
+ * current bit stream.
  */
-void PSK::writeBytes(int data, int size) {
-    wav_file_.write(reinterpret_cast<const char*> (&data), size);
+long long PSK::transmissionSampleCount() {
+    long long samples = bitStreamSampleCount();
+    if (morse_callsign_) {
+        samples += 2 * (long long) callSignSamples().size();
+    }
+    return samples;
 }
 
 /**
- * @brief Updates the 'data segment size' field in the wav header and closes
- * the file.
+ * @brief Adds the varicode of a character followed by the two 0 bit separator
+ * to the bit stream.
+ * @param c ASCII character [0 - 127]
  */
-void PSK::finalizeFile() {
-    int data_end_ = wav_file_.tellp(); // Save the position of the end of the 
-                                       // data chunk
-    wav_file_.seekp(data_start_ - 4); // Go to the beginning of the data chunk
-    writeBytes(data_end_ - data_start_, 4); // and write the size of the chunk.
-    wav_file_.seekp(4, std::ios::beg); // Go to the beginning of the file
-    writeBytes(data_end_ - 8, 4); // Write the size of the overall file
-    wav_file_.close();
+void PSK::addVaricode(char c) {
+    const VaricodeWord &word = varicode_words.words[c & 0x7f];
+    appendBits(word.bits, word.length);
 }
 
+// Bit Stream Methods
 /**
- * @brief Adds specified callsign to the wav file (morse code)
- * 
+ * @brief CRC-16/CCITT (polynomial 0x1021, MSB first) lookup table, one entry
+ * per byte value.
  */
-void PSK::addCallSign() {
+struct Crc16Table {
+    uint16_t values[256];
+};
 
+constexpr Crc16Table makeCrc16Table() {
+    Crc16Table table = {};
+    for (int i = 0; i < 256; i++) {
+        uint16_t crc = (uint16_t) (i << 8);
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (uint16_t) (crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1);
+        }
+        table.values[i] = crc;
+    }
+    return table;
 }
 
-void PSK::addVaricode(char c) {
-    uint16_t varicode = ascii_to_varicode[c];
-    //std::cout << std::endl << "Adding varicode for " << c << ":" << std::bitset<16>(varicode) << " ";
-    unsigned char bits[2];
-    int previous_bit = 1;
-    for (int i = 0; i < 16; i++) {
-        if (!(varicode & (1 << i)) && (!previous_bit)) {
-            //std::cout << "size: " << i - 1;
-
-            bits[0] = i > 9 ? varicode >> (i-9) : varicode << (9 - i);
-            bits[1] = i > 9 ? varicode << (17 - i) : 0x00;
-
-            //std::cout << " shifted: " << std::bitset<8>(bits[0]) << " " << std::bitset<8>(bits[1]) << std::endl;
-            addBits(bits, i - 1);
-            break;
-        } else {
-            previous_bit = varicode & (1 << i);
-        }
+constexpr Crc16Table crc16_table = makeCrc16Table();
+
+/**
+ * @brief Continues a CRC-16/CCITT over 'length' bytes. Starting from 0xFFFF
+ * gives CRC-16/CCITT-FALSE (0x29B1 for "123456789").
+ * @param crc CRC of the bytes before 'data'
+ * @param data 
+ * @param length 
+ */
+uint16_t PSK::crc16(uint16_t crc, const unsigned char *data, int length) {
+    for (int i = 0; i < length; i++) {
+        crc = (uint16_t) ((crc << 8) ^ crc16_table.values[(crc >> 8) ^ data[i]]);
     }
+    return crc;
 }
 
-// Bit Stream Methods
 /**
- * @brief Adds a bit to the bit stream.
+ * @brief Adds bits to the bit stream.
  * @details see format of 'bit stream' in header file. This function assumes
  * that you're adding bits in order (left to right). So if you want to add 1
  * you must add 0x80 with a 'num_bits' of 1. All numbers past 'num_bits'
@@ -296,44 +1643,51 @@ void PSK::addVaricode(char c) {
  * @param data 
  * @param num_bits 
  */
-void PSK::addBits(unsigned char *data, int num_bits) {
+void PSK::addBits(const unsigned char *data, int num_bits) {
     int data_index = 0;
-    int bit_index = 0; // Index of the bit in the byte, left to right [0 - 7]
-    int buffer_space;
-    
-    while (num_bits > 0) {
-        buffer_space = 32 - bit_stream_offset_;
-        
-        if (buffer_space == 0) { // buffer is full, write to bit stream
-            //std::cout << "Buffer full, writing to bit stream" << std::endl;
-            bit_stream_.push_back(bit_stream_buffer_);
-            bit_stream_buffer_ = 0;
-            bit_stream_offset_ = 0;
-            buffer_space = 32;
-        }
-
-        if (buffer_space >= num_bits && num_bits > 8) { // Write a byte at a time
-            //std::cout << "Writing a byte at a time" << std::endl;
-            bit_stream_buffer_ |= (data[data_index] << (32 - bit_stream_offset_ - 8));
-            bit_stream_offset_ += 8;
-            num_bits -= 8;
-            data_index++;
-        } else { // Write a bit at a time
-            //std::cout << "Writing a bit at a time" << std::endl;
-            bit_stream_buffer_ |= (data[data_index] & (1 << (7 - bit_index))) ? 1 << (32 - bit_stream_offset_ - 1) : 0;
-            bit_stream_offset_++;
-            num_bits--;
-            bit_index++;
-            if (bit_index == 8) {
-                bit_index = 0;
-                data_index++;
-            }
+    if (bit_stream_offset_ == 0) { // Word aligned, store whole words directly
+        size_t words = num_bits / 32;
+        size_t size = bit_stream_.size();
+        bit_stream_.resize(size + words);
+        uint32_t *out = bit_stream_.data() + size;
+        for (size_t i = 0; i < words; i++, data_index += 4) {
+            out[i] = (uint32_t) data[data_index] << 24
+                     | (uint32_t) data[data_index + 1] << 16
+                     | (uint32_t) data[data_index + 2] << 8
+                     | (uint32_t) data[data_index + 3];
         }
+        num_bits -= words * 32;
+    }
+    while (num_bits >= 32) { // Four bytes at a time
+        appendBits((uint32_t) data[data_index] << 24
+                   | (uint32_t) data[data_index + 1] << 16
+                   | (uint32_t) data[data_index + 2] << 8
+                   | (uint32_t) data[data_index + 3], 32);
+        data_index += 4;
+        num_bits -= 32;
+    }
+    while (num_bits >= 8) {
+        appendBits(data[data_index++], 8);
+        num_bits -= 8;
+    }
+    if (num_bits > 0) {
+        appendBits(data[data_index] >> (8 - num_bits), num_bits);
+    }
+}
 
-        //std::cout << "Buffer: " << std::bitset<32>(bit_stream_buffer_) << std::endl;
-        //for (int i = 0; i < bit_stream_.size(); i++) {
-        //    std::cout << "[" << i << "] " << std::bitset<32>(bit_stream_[i]) << std::endl;
-        //}
+/**
+ * @brief Appends up to 32 right aligned bits to the bit stream in one step.
+ * @details The bits are shifted into a 64 bit accumulator, and a 32 bit word
+ * is moved to the bit stream every time there are 32 or more bits pending.
+ * @param bits Right aligned bits, everything above 'num_bits' must be 0
+ * @param num_bits [0 - 32]
+ */
+void PSK::appendBits(uint32_t bits, int num_bits) {
+    bit_stream_buffer_ = (bit_stream_buffer_ << num_bits) | bits;
+    bit_stream_offset_ += num_bits;
+    if (bit_stream_offset_ >= 32) {
+        bit_stream_offset_ -= 32;
+        bit_stream_.push_back((uint32_t) (bit_stream_buffer_ >> bit_stream_offset_));
     }
 }
 
@@ -343,19 +1697,26 @@ void PSK::addBits(unsigned char *data, int num_bits) {
  * 
  */
 void PSK::pushBufferToBitStream() {
-    bit_stream_.push_back(bit_stream_buffer_);
+    if (bit_stream_offset_ > 0) { // Left align the remaining bits
+        bit_stream_.push_back((uint32_t) (bit_stream_buffer_ << (32 - bit_stream_offset_)));
+    }
     bit_stream_buffer_ = 0;
     bit_stream_offset_ = 0;
-    bit_stream_index_ = 0;
 }
 
 /**
  * @brief Adds the preamble to the bit stream.
  */
 void PSK::addPreamble() {
-    static unsigned char zeros[1] = {0x00};
-    for (int i = 0; i < preamble_length_; i++) {
-        addBits(zeros, 1);
+    addIdle(preamble_length_);
+}
+
+/**
+ * @brief Adds 'symbols' idle symbols (0's, phase reversals) to the bit stream.
+ */
+void PSK::addIdle(int symbols) {
+    for (int i = 0; i < symbols; i += 32) {
+        appendBits(0, std::min(32, symbols - i));
     }
 }
 
@@ -368,196 +1729,732 @@ void PSK::addPreamble() {
  */
 void PSK::addPostamble() {
     const int fldigi_postamble_mode_ = 0;
-    static unsigned char zeros[1] = {0x00};
-    static unsigned char ones[1] = {0xFF};
-    while ((32 - bit_stream_offset_) >= 1) {
-        addBits((mode_ == QPSK && fldigi_postamble_mode_ ? zeros : ones), 1);
+    const uint32_t bits = mode_ == QPSK && fldigi_postamble_mode_ ? 0 : 0xFFFFFFFF;
+    if (bit_stream_offset_ > 0) { // Pad to the end of the current word
+        int padding = 32 - bit_stream_offset_;
+        appendBits(bits >> (32 - padding), padding);
     }
-    for (int i = 0; i < postamble_length_; i++) {
-        addBits((mode_ == QPSK && fldigi_postamble_mode_ ? zeros : ones), 1);
+    for (int i = 0; i < postamble_length_; i += 32) {
+        int length = std::min(32, postamble_length_ - i);
+        appendBits(bits >> (32 - length), length);
     }
 }
 
+// Modulation Methods
 /**
- * @brief Returns the next bit of the bit stream that will be encoded.
+ * @brief Goes through the bit stream and modulates it on the thread pool or
+ * with the serial modulator selected by setup() (see PSKModulator.h).
+ * @details With BPSK31, the bit 0 is encoded by switching phases and the bit 1 
+ * is encoded by keeping the phase shift the same.
  * 
- * @return int [1, 0, -1] -1 = no more bits in bit stream
+ * In QPSK mode each bit is shifted into the convolutional encoder and the
+ * resulting phase shift is added to the current phase. The end of a symbol is
+ * filtered when the following symbol changes phase.
+ */
+void PSK::encodeBitStream() {
+    encodeBitStream(bit_stream_.size());
+}
+
+/**
+ * @brief Encodes the first 'words' words of the bit stream. The last symbol
+ * looks ahead into the word after them, so the bit stream continues.
+ * @param words [0 - bit_stream_.size()]
  */
-int PSK::popNextBit() {
-    if (bit_stream_index_ >= bit_stream_.size()) { // No more bits in bit stream
-        return -1;
+void PSK::encodeBitStream(size_t words) {
+#if PSK_STATS
+    if (stats_enabled_) {
+        double io_seconds = stats_.io_seconds;
+        long long samples = symbolClockSamples(symbol_clock_, (long long) words * 32);
+        double seconds = 0;
+        {
+            StatsTimer timer(&seconds);
+            modulateBitStream(words);
+        }
+        // Flushes during encoding are timed as I/O, not modulation
+        stats_.modulation_seconds += seconds - (stats_.io_seconds - io_seconds);
+        stats_.symbols += (long long) words * 32;
+        stats_.samples += samples;
+        updatePeakBufferBytes();
+        return;
     }
+#endif
+    modulateBitStream(words);
+}
 
-    uint32_t bit = bit_stream_[bit_stream_index_] & (1 << (31 - bit_stream_offset_));
-    
-    bit_stream_offset_++;
-    if (bit_stream_offset_ == 32) {
-        bit_stream_offset_ = 0;
-        bit_stream_index_++;
+/**
+ * @brief Maps and renders the first 'words' words of the bit stream, see
+ * encodeBitStream().
+ */
+void PSK::modulateBitStream(size_t words) {
+    // An appended transmission has no fixed start, see beginTextData()
+    if (incremental_.enabled && !appending_ && words == bit_stream_.size()) {
+        encodeBitStreamIncremental();
+        return;
     }
+    if (encodeBitStreamParallel(words)) {
+        return;
+    }
+    modulator_(*this, 0, words, nullptr); // Specialized for the mode and symbol length
+}
+
+/**
+ * @brief Returns the state that the rendering of the next symbol depends on.
+ */
+PSK::ModulatorState PSK::modulatorState() const {
+    ModulatorState state;
+    state.encoder = encoder_;
+    state.carrier_phase = carrier_phase_;
+    state.symbol_clock = symbol_clock_;
+    state.last_transition = last_transition_;
+    return state;
+}
 
-    return bit ? 1 : 0;
+void PSK::restoreModulatorState(const ModulatorState &state) {
+    encoder_ = state.encoder;
+    carrier_phase_ = state.carrier_phase;
+    symbol_clock_ = state.symbol_clock;
+    last_transition_ = state.last_transition;
+}
+
+bool PSK::sameModulatorState(const ModulatorState &a, const ModulatorState &b) {
+    return a.encoder.last_phase == b.encoder.last_phase
+           && a.encoder.symbol_phase == b.encoder.symbol_phase
+           && a.encoder.conv_code_buffer == b.encoder.conv_code_buffer
+           && a.carrier_phase == b.carrier_phase
+           && a.symbol_clock == b.symbol_clock
+           && a.last_transition == b.last_transition;
 }
 
 /**
- * @brief Returns the next bit of the bit stream without removing it.
- * @return int [1, 0, -1] -1 = no more bits in bit stream
+ * @brief Encodes the bit stream, rendering only the words that differ from
+ * the last body and copying the rest from the incremental cache. See
+ * incremental_ and setIncremental().
  */
-int PSK::peakNextBit() {
-    if (bit_stream_index_ >= bit_stream_.size()) { // No more bits in bit stream
-        return -1;
+void PSK::encodeBitStreamIncremental() {
+    IncrementalCache &cache = incremental_;
+    const ModulatorState initial = modulatorState();
+    if (cache.valid && !sameModulatorState(initial, cache.checkpoints[0])) {
+        cache.valid = false; // Cached audio started from another state
+    }
+    const size_t words = bit_stream_.size();
+    const size_t cached_words = cache.valid ? cache.bit_stream.size() : 0;
+
+    // Words [0, prefix) are unchanged, so is the audio up to word 'start'
+    size_t prefix = 0;
+    while (prefix < words && prefix < cached_words
+           && bit_stream_[prefix] == cache.bit_stream[prefix]) {
+        prefix++;
+    }
+    size_t start = prefix;
+    if (prefix > 0 && (prefix < words || prefix < cached_words)) {
+        start = prefix - 1;
+    }
+    // The last 'suffix' words are unchanged too
+    size_t suffix = 0;
+    while (suffix < words - start && suffix < cached_words - start
+           && bit_stream_[words - 1 - suffix] == cache.bit_stream[cached_words - 1 - suffix]) {
+        suffix++;
+    }
+    const size_t resume = words - suffix;
+    const size_t cached_resume = cached_words - suffix;
+
+    // The cached body is edited in place, the tail that may be reused is
+    // kept aside first as the changed span can have a different length
+    std::vector<int16_t> &samples = cache.samples;
+    std::vector<ModulatorState> &checkpoints = cache.checkpoints;
+    if (suffix > 0) {
+        long long tail_first = symbolClockSamples(initial.symbol_clock, (long long) cached_resume * 32);
+        cache.tail_samples.assign(samples.begin() + tail_first, samples.end());
+        cache.tail_checkpoints.assign(checkpoints.begin() + cached_resume, checkpoints.end());
     }
-    uint32_t bit = bit_stream_[bit_stream_index_] & (1 << (31 - bit_stream_offset_));
-    return bit ? 1 : 0;
+    long long prefix_samples = symbolClockSamples(initial.symbol_clock, (long long) start * 32);
+    samples.resize(prefix_samples);
+    samples.reserve(bitStreamSampleCount());
+    checkpoints.resize(start + 1);
+    checkpoints.resize(words + 1);
+    checkpoints[0] = initial;
+    restoreModulatorState(checkpoints[start]);
+    PSK_STATS_ADD(reused_samples, prefix_samples);
+
+    // Render the changed words into the cache, then write the whole body
+    cache.valid = false; // Until the body is complete
+    {
+        OutputGuard guard(*this);
+        output_target_ = SAMPLE_VECTOR;
+        sample_vector_ = &samples;
+        modulator_(*this, start, resume, checkpoints.data());
+        if (suffix > 0 && sameModulatorState(checkpoints[resume], cache.tail_checkpoints[0])) {
+            samples.insert(samples.end(), cache.tail_samples.begin(), cache.tail_samples.end());
+            std::copy(cache.tail_checkpoints.begin(), cache.tail_checkpoints.end(),
+                      checkpoints.begin() + resume);
+            restoreModulatorState(checkpoints[words]);
+            PSK_STATS_ADD(reused_samples, (long long) cache.tail_samples.size());
+        } else {
+            modulator_(*this, resume, words, checkpoints.data());
+        }
+    }
+
+    cache.bit_stream = bit_stream_;
+    cache.valid = true;
+    writeSamples(cache.samples.data(), cache.samples.size());
 }
 
-// Modulation Methods
 /**
- * @brief Goes throught he bit stream and modulates with the addSymbol method.
- * @details With BPSK31, the bit 0 is encoded by switching phases and the bit 1 
- * is encoded by keeping the phase shift the same.
+ * @brief Encodes the first 'num_words' words of the bit stream on the thread
+ * pool, see the members in the header for how it is split.
+ * @return false - the pool is not enabled or the bit stream is too short to
+ * split, nothing was encoded
  */
-void PSK::encodeBitStream() {
-    if (mode_ == BPSK) { // BPSK modulation
-        int bit = popNextBit();
-        int next_bit = peakNextBit();
-        int last_phase = 0; // 0 = 0, 1 = M_PI
-        while (bit != -1) { 
-            if (bit) { // Encode a 1 by keeping the phase shift the same
-                int filter_end = next_bit == 1 ? 0 : 1; // If next bit is 1, do not filter end of symbol.
-                addSymbol(last_phase ? 0 : M_PI, filter_end);
-            } else if (!bit) { // Encode a 0 by switching phase
-                int filter_end = next_bit == 1 ? 0 : 1; // If next bit is 1, do not filter end of symbol.
-                addSymbol(last_phase ? M_PI : 0, filter_end);
-                last_phase = !last_phase;
+bool PSK::encodeBitStreamParallel(size_t num_words) {
+    if (!thread_pool_) {
+        return false;
+    }
+    const int threads = thread_pool_->size();
+    if (num_words < (size_t) parallel_min_words_ * threads) {
+        return false;
+    }
+
+    // Split into a few chunks per thread so that uneven chunks balance out
+    size_t chunk_words = std::max((size_t) parallel_min_words_,
+                                  (num_words + threads * 4 - 1) / (threads * 4));
+    int num_chunks = (num_words + chunk_words - 1) / chunk_words;
+
+    auto bitAt = [this](size_t index) {
+        return (int) ((bit_stream_[index / 32] >> (31 - index % 32)) & 1);
+    };
+    auto bufferBefore = [&](size_t symbol) { // 5 bits before 'symbol'
+        unsigned char buffer = encoder_.conv_code_buffer;
+        for (size_t i = symbol < 5 ? 0 : symbol - 5; i < symbol; i++) {
+            buffer = ((buffer << 1) | bitAt(i)) & 0x1f;
+        }
+        return buffer;
+    };
+
+    // Pass 1: change of the BPSK/QPSK phase over each chunk
+    std::vector<int> chunk_delta(num_chunks);
+    thread_pool_->parallelFor(num_chunks, [&](int chunk, int) {
+        size_t first = chunk * chunk_words;
+        size_t last = std::min(num_words, first + chunk_words);
+        int delta = 0;
+        if (mode_ == BPSK) { // Parity of the 0 bits
+            for (size_t i = first; i < last; i++) {
+                delta ^= __builtin_popcount(~bit_stream_[i]) & 1;
+            }
+        } else { // Sum of the phase shifts
+            unsigned char buffer = bufferBefore(first * 32);
+            for (size_t i = first * 32; i < last * 32; i++) {
+                buffer = ((buffer << 1) | bitAt(i)) & 0x1f;
+                delta += conv_code[buffer];
+            }
+        }
+        chunk_delta[chunk] = delta;
+    });
+
+    // Prefix scan: encoder state at the start of each chunk
+    std::vector<EncoderState> chunk_state(num_chunks);
+    EncoderState state = encoder_;
+    for (int chunk = 0; chunk < num_chunks; chunk++) {
+        chunk_state[chunk] = state;
+        if (chunk > 0 && mode_ == QPSK) {
+            chunk_state[chunk].conv_code_buffer = bufferBefore(chunk * chunk_words * 32);
+        }
+        if (mode_ == BPSK) {
+            state.last_phase ^= chunk_delta[chunk];
+        } else {
+            state.symbol_phase = (state.symbol_phase + chunk_delta[chunk]) & 3;
+        }
+    }
+
+    // Pass 2: render every chunk into its own region of the output
+    const long long total_samples = symbolClockSamples(symbol_clock_, (long long) num_words * 32);
+    std::vector<int16_t> rendered;
+    int16_t *out;
+    if (output_target_ == SAMPLE_VECTOR) {
+        size_t size = sample_vector_->size();
+        sample_vector_->resize(size + total_samples);
+        out = sample_vector_->data() + size;
+    } else if (output_target_ == MAPPED_FILE) { // Sized for the whole stream
+        out = mapped_samples_ + mapped_fill_;
+    } else {
+        rendered.resize(total_samples);
+        out = rendered.data();
+    }
+
+    EncoderState end_state;
+    int end_transition = last_transition_;
+    thread_pool_->parallelFor(num_chunks, [&](int chunk, int worker) {
+        const size_t batch_size = 256;
+        Symbol symbols[batch_size];
+        size_t first_word = chunk * chunk_words;
+        size_t symbols_left = (std::min(num_words, first_word + chunk_words) - first_word) * 32;
+        size_t first_symbol = first_word * 32;
+
+        EncoderState chunk_encoder = chunk_state[chunk];
+        const long long first_sample = symbolClockSamples(symbol_clock_, first_symbol);
+        int symbol_clock = symbolClockAfter(symbol_clock_, first_symbol);
+        int carrier_phase = (carrier_phase_ + first_sample) % carrier_period_;
+        int transition_in = last_transition_;
+        if (chunk > 0) { // Transition at the end of the previous symbol
+            EncoderState previous = chunk_state[chunk];
+            int phase;
+            previous.conv_code_buffer = bufferBefore(first_symbol - 1);
+            mapSymbol(previous, bitAt(first_symbol - 1), bitAt(first_symbol),
+                      phase, transition_in);
+        }
+
+        BitStreamReader reader(bit_stream_.data() + first_word,
+                               bit_stream_.size() - first_word); // Looks ahead past num_words
+        int16_t *dst = out + first_sample;
+        size_t count;
+        while (symbols_left > 0 &&
+               (count = mapSymbols(chunk_encoder, reader, symbols,
+                                   std::min(batch_size, symbols_left))) > 0) {
+            for (size_t i = 0; i < count; i++) {
+                int length = nextSymbolLength(symbol_clock);
+                const int16_t *samples = symbolSamples(worker_templates_[worker], length,
+                                                       carrier_phase,
+                                                       symbols[i].phase,
+                                                       transition_in,
+                                                       symbols[i].transition, dst);
+                if (samples != dst) {
+                    std::memcpy(dst, samples, length * sizeof(int16_t));
+                }
+                dst += length;
+                carrier_phase = (carrier_phase + length) % carrier_period_;
+                transition_in = symbols[i].transition;
             }
-            last_phase ? "1" : "0";
-            bit = popNextBit();
-            next_bit = peakNextBit();
-        }
-    } else if (mode_ == QPSK) { // QPSK modulation
-        unsigned char buffer = 0;
-        int bit = popNextBit();
-        int shift = 0;
-        while (bit != -1) {
-            buffer = ((buffer << 1) | bit) & 0x1f;
-            int filter_end = 0;
-            if (shift != conv_code[buffer]) {
-                filter_end = 1;
+            symbols_left -= count;
+        }
+        if (chunk == num_chunks - 1) {
+            end_state = chunk_encoder;
+            end_transition = transition_in;
+        }
+    });
+
+    encoder_ = end_state;
+    last_transition_ = end_transition;
+    carrier_phase_ = (carrier_phase_ + total_samples) % carrier_period_;
+    symbol_clock_ = symbolClockAfter(symbol_clock_, (long long) num_words * 32);
+    if (output_target_ == MAPPED_FILE) {
+        mapped_fill_ += total_samples;
+    } else if (output_target_ != SAMPLE_VECTOR) {
+        writeSamples(out, total_samples);
+    }
+    return true;
+}
+
+/**
+ * @brief Maps up to 'max_symbols' bits from the reader to symbol descriptors.
+ * 
+ * @param state Encoder state, updated as bits are mapped
+ * @param reader Bit stream to read from
+ * @param symbols Array of at least 'max_symbols' descriptors to fill
+ * @param max_symbols 
+ * @return size_t Number of descriptors filled, 0 once the reader is empty
+ */
+size_t PSK::mapSymbols(EncoderState &state, BitStreamReader &reader,
+                       Symbol *symbols, size_t max_symbols) const {
+    size_t count = 0;
+    if (mode_ == QPSK) { // A byte per lookup, see PSKModulator::mapByte()
+        while (count + 8 <= max_symbols && reader.byteAligned()) {
+            PSKModulator<QPSK, 0>::mapByte(state, reader.byte(), reader.nextByteBit(),
+                                           symbols + count);
+            count += 8;
+            reader.advanceByte();
+        }
+    }
+    while (count < max_symbols && !reader.empty()) {
+        int phase;
+        int transition;
+        mapSymbol(state, reader.bit(), reader.nextBit(), phase, transition);
+        symbols[count].phase = phase;
+        symbols[count].transition = transition;
+        count++;
+        reader.advance();
+    }
+    return count;
+}
+
+/**
+ * @brief Maps the next bit of the bit stream to the phase of its symbol and
+ * updates the BPSK/QPSK encoder state.
+ * 
+ * @param state Encoder state
+ * @param bit The bit to encode [1, 0]
+ * @param next_bit The bit after it [1, 0, -1] -1 = end of bit stream
+ * @param phase Set to the phase of the symbol in quarter turns [0 - 3]
+ * @param transition Set to the phase shift from this symbol to the next in
+ * quarter turns [0 - 3]. The end of the bit stream counts as a reversal (2)
+ * so that the signal fades out.
+ */
+void PSK::mapSymbol(EncoderState &state, int bit, int next_bit, int &phase,
+                    int &transition) const {
+    if (mode_ == BPSK) {
+        // If next bit is 1, the phase stays the same.
+        transition = next_bit == 1 ? 0 : 2;
+        phase = (state.last_phase ^ bit) ? 2 : 0;
+        if (!bit) { // Encode a 0 by switching phase
+            state.last_phase = !state.last_phase;
+        }
+    } else {
+        state.conv_code_buffer = ((state.conv_code_buffer << 1) | bit) & 0x1f;
+        state.symbol_phase = (state.symbol_phase + conv_code[state.conv_code_buffer]) & 3;
+        unsigned char next_buffer = ((state.conv_code_buffer << 1) | (next_bit & 1)) & 0x1f;
+        transition = next_bit == -1 ? 2 : conv_code[next_buffer];
+        phase = state.symbol_phase;
+    }
+}
+
+/**
+ * @brief Renders the bit stream as complex baseband, see encodeTextDataIQ().
+ * @details The symbols come from the same mapping as encodeBitStream(). The
+ * phase of a symbol is a quarter turn rotation, so apart from the pulse
+ * tables no trigonometry is needed.
+ * @param oversampling Samples per symbol
+ * @param out Interleaved I, Q samples are appended to this
+ */
+void PSK::renderBaseband(int oversampling, std::vector<float> &out) {
+    if (oversampling < 2) {
+        throw std::invalid_argument("Oversampling must be at least 2");
+    }
+    PSK_STATS_TIMER(modulation_seconds);
+    PSK_STATS_ADD(symbols, (long long) bit_stream_.size() * 32);
+    PSK_STATS_ADD(samples, (long long) bit_stream_.size() * 32 * oversampling);
+#if PSK_STATS
+    if (stats_enabled_) {
+        updatePeakBufferBytes();
+    }
+#endif
+    // Pulse shapes at the baseband rate, same as the passband renderers
+    std::vector<float> envelope(oversampling);
+    std::vector<float> pulse(oversampling);
+    int time = 0 - (oversampling / 2);
+    for (int i = 0; i < oversampling; i++, time++) {
+        envelope[i] = std::pow(std::cos( (std::abs(time) / (double) oversampling) * 2.9 ), 2.0);
+        double cosine = std::cos(M_PI * std::abs(time) / (2.0 * oversampling));
+        pulse[i] = cosine * cosine;
+    }
+    const int rotation_i[4] = {1, 0, -1, 0};
+    const int rotation_q[4] = {0, 1, 0, -1};
+
+    out.reserve(out.size() + bit_stream_.size() * 32 * oversampling * 2);
+    const size_t batch_size = 256;
+    Symbol symbols[batch_size];
+    BitStreamReader reader(bit_stream_.data(), bit_stream_.size());
+    size_t count;
+    while ((count = mapSymbols(encoder_, reader, symbols, batch_size)) > 0) {
+        for (size_t s = 0; s < count; s++) {
+            int phase = symbols[s].phase;
+            int transition_in = last_transition_;
+            int transition_out = symbols[s].transition;
+            int previous = (4 - transition_in) & 3;
+            time = 0 - (oversampling / 2);
+            for (int i = 0; i < oversampling; i++, time++) {
+                // Baseband relative to this symbol's phase
+                float in_phase;
+                float quadrature = 0;
+                if (pulse_shape_ == RAISED_COSINE) {
+                    int neighbour = time < 0 ? previous : transition_out;
+                    float overlap = 1.0f - pulse[i];
+                    in_phase = pulse[i] + rotation_i[neighbour] * overlap;
+                    quadrature = rotation_q[neighbour] * overlap;
+                } else {
+                    bool filtered = time < 0 ? transition_in != 0 : transition_out != 0;
+                    in_phase = filtered ? envelope[i] : 1.0f;
+                }
+                // Rotate by the symbol phase
+                out.push_back(rotation_i[phase] * in_phase - rotation_q[phase] * quadrature);
+                out.push_back(rotation_q[phase] * in_phase + rotation_i[phase] * quadrature);
             }
-            shift += conv_code[buffer];
-            addSymbol(shift, filter_end);
-            bit = popNextBit();
+            last_transition_ = transition_out;
         }
     }
 }
 
 /**
- * @brief Modulates a single symbol in BPSK/QPSK and saves the audio data to the
- * wav file.
+ * @brief Records the memory held by the bit stream, the output buffer and the
+ * template caches in stats() if it is a new peak.
+ */
+void PSK::updatePeakBufferBytes() {
+    size_t bytes = bit_stream_.capacity() * sizeof(uint32_t)
+                 + sample_buffer_.capacity() * sizeof(int16_t)
+                 + call_sign_samples_.capacity() * sizeof(int16_t);
+    auto template_bytes = [](const SymbolTemplates &templates) {
+        return templates.index.capacity() * sizeof(int)
+             + templates.samples.capacity() * sizeof(int16_t);
+    };
+    bytes += template_bytes(symbol_templates_);
+    bytes += incremental_.bit_stream.capacity() * sizeof(uint32_t)
+           + (incremental_.samples.capacity() + incremental_.tail_samples.capacity())
+             * sizeof(int16_t)
+           + (incremental_.checkpoints.capacity() + incremental_.tail_checkpoints.capacity())
+             * sizeof(ModulatorState);
+    for (const SymbolTemplates &templates : worker_templates_) {
+        bytes += template_bytes(templates);
+    }
+    stats_.peak_buffer_bytes = std::max(stats_.peak_buffer_bytes, bytes);
+}
+
+/**
+ * @brief Passes already rendered samples through the output stage.
+ * @param samples 
+ * @param count 
+ */
+void PSK::writeSamples(const int16_t *samples, long long count) {
+    while (count > 0) {
+        int n = (int) std::min<long long>(count, output_chunk_size_);
+        std::memcpy(reserveSamples(n), samples, n * sizeof(int16_t));
+        commitSamples(n);
+        samples += n;
+        count -= n;
+    }
+}
+
+/**
+ * @brief Produces the samples of the next symbol and advances the carrier
+ * and filter state.
+ * @details Returns the cached template when the template cache is enabled
+ * (valid until the next call), otherwise renders into 'scratch'.
+ * 
+ * @param phase The shift of the carrier wave in quarter turns [0 - 3]
+ * @param transition Phase shift to the next symbol in quarter turns [0 - 3]
+ * @param scratch Buffer of at least samples_per_symbol_ + 1 samples
+ * @param length Set to the length of the symbol from the symbol clock
+ * @return const int16_t* 'length' samples
+ */
+const int16_t *PSK::nextSymbolSamples(int phase, int transition,
+                                      int16_t *scratch, int &length) {
+    length = nextSymbolLength(symbol_clock_);
+    const int16_t *samples = symbolSamples(symbol_templates_, length, carrier_phase_,
+                                           phase, last_transition_,
+                                           transition, scratch);
+    carrier_phase_ = (carrier_phase_ + length) % carrier_period_;
+    last_transition_ = transition;
+    return samples;
+}
+
+/**
+ * @brief Produces the samples of one symbol from a template cache, or renders
+ * them into 'scratch' if the cache is disabled.
+ * @return const int16_t* 'length' samples
+ */
+const int16_t *PSK::symbolSamples(SymbolTemplates &templates, int length,
+                                  int carrier_phase, int phase, int transition_in,
+                                  int transition_out, int16_t *scratch) const {
+    if (templates.enabled) {
+        return getSymbolTemplate(templates, length, carrier_phase, phase,
+                                 transition_in, transition_out);
+    }
+    if (vectorized_ && !fixed_point_ && pulse_shape_ == ENVELOPE) {
+        renderSymbolSimd(scratch, length, carrier_phase, phase, transition_in != 0,
+                         transition_out != 0);
+    } else {
+        renderSymbol(scratch, length, carrier_phase, phase, transition_in,
+                     transition_out);
+    }
+    return scratch;
+}
+
+/**
+ * @brief Renders a single symbol into a sample buffer with the selected
+ * renderer. The template cache is filled from this.
  * 
- * @param shift The shift of the carrier wave in degrees
- * @param filter_end Whether or not to apply the filter to the end of the symbol
+ * @param out Buffer of at least 'length' samples
+ * @param length Length of the symbol in samples, samples_per_symbol_ or one more
+ * @param carrier_phase Carrier phase (in samples) at the start of the symbol
+ * @param phase The shift of the carrier wave in quarter turns [0 - 3]
+ * @param transition_in Phase shift from the previous symbol [0 - 3]
+ * @param transition_out Phase shift to the next symbol [0 - 3]
+ */
+void PSK::renderSymbol(int16_t *out, int length, int carrier_phase, int phase,
+                       int transition_in, int transition_out) const {
+    if (pulse_shape_ == RAISED_COSINE) {
+        if (fixed_point_) {
+            renderShapedFixed(out, length, carrier_phase, phase, transition_in,
+                              transition_out);
+        } else {
+            renderShapedFloat(out, length, carrier_phase, phase, transition_in,
+                              transition_out);
+        }
+        return;
+    }
+    // The envelope is filtered on the side of any phase change
+    int filter_start = transition_in != 0;
+    int filter_end = transition_out != 0;
+    if (fixed_point_) {
+        renderSymbolFixed(out, length, carrier_phase, phase, filter_start, filter_end);
+    } else {
+        renderSymbolFloat(out, length, carrier_phase, phase, filter_start, filter_end);
+    }
+}
+
+/**
+ * @brief Renders a single symbol with double precision math. This is the
+ * reference implementation. See renderSymbol() for parameters.
  */
-void PSK::addSymbol(double shift, int filter_end) {
+void PSK::renderSymbolFloat(int16_t *out, int length, int carrier_phase,
+                            int phase, int filter_start, int filter_end) const {
     const double power = 2.0;
     const double roll_off = 2.9;
     const double amplitude = .5;
+    const double shift = phase * (M_PI / 2.0);
 
-    double time = 0 - (samples_per_symbol_ / 2);
-    for (int i = 0; i < samples_per_symbol_; i++) {
-        double unfiltered = std::cos(carrier_wave_angle_ + shift);
-        double filter = std::pow(std::cos( (abs(time) / samples_per_symbol_) * roll_off ), power);
-        if (!last_symbol_end_filtered_ && (time < 0)) {
+    double time = 0 - (length / 2);
+    for (int i = 0; i < length; i++) {
+        double unfiltered = std::cos(angle_delta_ * carrier_phase + shift);
+        double filter = std::pow(std::cos( (abs(time) / length) * roll_off ), power);
+        if (!filter_start && (time < 0)) {
             filter = 1;
         }
         if (!filter_end && (time > 0)) { // Remove filter from end of symbol
             filter = 1;
         }
-        int sample = amplitude * filter * unfiltered * max_amplitude_;
-        carrier_wave_angle_ += angle_delta_;
+        out[i] = amplitude * filter * unfiltered * max_amplitude_;
         time += 1;
-        if (carrier_wave_angle_ > 2 * M_PI) {
-            carrier_wave_angle_ -= 2 * M_PI;
+        if (++carrier_phase == carrier_period_) {
+            carrier_phase = 0;
         }
-        writeBytes(sample, 2); // write sample to wav file
     }
-    last_symbol_end_filtered_ = filter_end;
 }
 
 /**
- * @brief Main function for when using as a command line utility.
- * @details
- * Usage: ./psk -m [mode] -s [symbol_rate] -f [filename] -t "text to encode"
- * or echo "test" | ./psk # uses defaults 
+ * @brief Renders a single symbol with the integer NCO and the Q15 pulse shape.
+ * See renderSymbol() for parameters.
+ * @details The sample is amplitude (0.5) * filter * carrier, with the carrier
+ * in Q15 scaled to max_amplitude_.
  */
-int main(int argc, char** argv) {
-    std::string message = "";
-    std::string filename = "out.wav";
-    PSK::Mode mode = PSK::BPSK;
-    PSK::SymbolRate symbol_rate = PSK::S125;
+void PSK::renderSymbolFixed(int16_t *out, int length, int carrier_phase,
+                            int phase, int filter_start, int filter_end) const {
+    const int32_t unity = 1 << 15;
+    const int32_t *filter_shape = &filter_shape_q15_[pulseTableOffset(length)];
+    // Phase word at the start of the symbol plus a quarter turn for cosine
+    uint32_t nco = (uint32_t) carrier_phase * phase_step_
+                   + ((uint32_t) (phase + 1) << 30);
+    int half = length / 2;
 
-    int message_flag = 0;
-
-    for (int i = 0; i < argc; i++) {
-        if (std::string(argv[i]) == "-m") {
-            std::cout << "mode" << std::endl;
-            if (std::string(argv[i + 1]) == "bpsk") {
-                mode = PSK::BPSK;
-            } else if (std::string(argv[i + 1]) == "qpsk") {
-                mode = PSK::QPSK;
-            } else {
-                std::cout << "Invalid mode: -m bpsk | -m qpsk" << std::endl;
-                return 1;
-            }
-        }
-        if (std::string(argv[i]) == "-s") {
-            if (std::string(argv[i + 1]) == "125") {
-                symbol_rate = PSK::S125;
-            } else if (std::string(argv[i + 1]) == "250") {
-                symbol_rate = PSK::S250;
-            } else if (std::string(argv[i + 1]) == "500") {
-                symbol_rate = PSK::S500;
-            } else if (std::string(argv[i + 1]) == "1000") {
-                symbol_rate = PSK::S1000;
-            } else {
-                std::cout << "Invalid symbol rate: -s 125 | -s 250 | -s 500" << std::endl;
-                return 1;
-            }
+    for (int i = 0; i < length; i++) {
+        int32_t filter = filter_shape[i];
+        if (!filter_start && i < half) {
+            filter = unity;
         }
-        if (std::string(argv[i]) == "-f") {
-           filename = std::string(argv[i + 1]);
-        }
-        if (std::string(argv[i]) == "-t") {
-            message = std::string(argv[i + 1]);
-            message_flag = 1;
+        if (!filter_end && i > half) { // Remove filter from end of symbol
+            filter = unity;
         }
+        int32_t carrier = sineQ15(nco);
+        out[i] = (int16_t) ((filter * carrier) / (2 * unity));
+        nco += phase_step_;
     }
+}
+
+/**
+ * @brief Renders a single symbol with the vectorized kernel. See
+ * renderSymbol() for parameters.
+ */
+void PSK::renderSymbolSimd(int16_t *out, int length, int carrier_phase,
+                           int phase, int filter_start, int filter_end) const {
+    // Carrier phase in turns, reduced exactly with integer math
+    long long cycles = (long long) carrier_phase * carrier_freq_ % sample_rate_;
+    double start_turns = (double) cycles / sample_rate_ + phase / 4.0;
+    double step_turns = (double) carrier_freq_ / sample_rate_;
+    const float *envelope = &envelope_[4 * pulseTableOffset(length)
+                                       + ((filter_start ? 1 : 0) * 2
+                                          + (filter_end ? 1 : 0)) * length];
+    renderCarrierSimd(out, envelope, start_turns, step_turns, length);
+}
+
+/**
+ * @brief Renders a single symbol with the raised cosine pulse shape in double
+ * precision. See renderSymbol() for parameters.
+ * @details The baseband signal is the sum of one raised cosine pulse per
+ * symbol, each two symbols long, so the first half of the symbol only
+ * depends on the previous symbol and the second half on the next one. Taken
+ * relative to this symbol's phase the baseband is
+ * pulse + rotation * overlap, where the rotation is the phase shift to the
+ * neighbouring symbol. It is then mixed up to the carrier:
+ * I * cos(carrier) - Q * sin(carrier).
+ */
+void PSK::renderShapedFloat(int16_t *out, int length, int carrier_phase,
+                            int phase, int transition_in, int transition_out) const {
+    const double amplitude = .5;
+    const double *pulse = &pulse_[pulseTableOffset(length)];
+    const double *pulse_overlap = &pulse_overlap_[pulseTableOffset(length)];
+    const double shift = phase * (M_PI / 2.0);
+    // Neighbouring symbol relative to this one, quarter turn rotations
+    const int rotation_i[4] = {1, 0, -1, 0};
+    const int rotation_q[4] = {0, 1, 0, -1};
+    const int previous = (4 - transition_in) & 3;
 
-    if (!message_flag) {
-        std::cout << "Enter message (Ctrl+D after newline to end): \n";
-        std::string line;
-        std::stringstream buffer;
-        while (std::getline(std::cin, line)){
-            buffer << line;
-            buffer << "\n";
+    int time = 0 - (length / 2);
+    for (int i = 0; i < length; i++, time++) {
+        int neighbour = time < 0 ? previous : transition_out;
+        double in_phase = pulse[i] + rotation_i[neighbour] * pulse_overlap[i];
+        double quadrature = rotation_q[neighbour] * pulse_overlap[i];
+        double angle = angle_delta_ * carrier_phase + shift;
+        out[i] = amplitude * (in_phase * std::cos(angle) - quadrature * std::sin(angle))
+                 * max_amplitude_;
+        if (++carrier_phase == carrier_period_) {
+            carrier_phase = 0;
         }
-        message = buffer.str();
     }
+}
 
-    if (message.size() < 2) {
-        std::cout << "No message detected!" << std::endl;
-        return 1;
-    } else {
-        std::cout << std::endl << "Encoding message: \n" << message << std::endl;
-    }
+/**
+ * @brief Renders a single symbol with the raised cosine pulse shape using the
+ * integer NCO and Q15 pulse tables. See renderShapedFloat() for the math.
+ */
+void PSK::renderShapedFixed(int16_t *out, int length, int carrier_phase,
+                            int phase, int transition_in, int transition_out) const {
+    const int32_t unity = 1 << 15;
+    const int32_t *pulse = &pulse_q15_[pulseTableOffset(length)];
+    const int rotation_i[4] = {1, 0, -1, 0};
+    const int rotation_q[4] = {0, 1, 0, -1};
+    const int previous = (4 - transition_in) & 3;
+    // Phase word at the start of the symbol plus a quarter turn for cosine
+    uint32_t nco = (uint32_t) carrier_phase * phase_step_
+                   + ((uint32_t) (phase + 1) << 30);
+    int half = length / 2;
 
-    std::cout << "Mode: " << (mode == PSK::BPSK ? "BPSK" : "QPSK") << ", ";
-    std::cout << "Symbol Rate: " << (symbol_rate == PSK::S125 ? "125" : (symbol_rate == PSK::S250 ? "250" : (symbol_rate == PSK::S500 ? "500" : "1000"))) << ", ";
-    std::cout << "Filename: " << filename << std::endl;
-    std::cout << "Generating audio file..." << std::endl;
+    for (int i = 0; i < length; i++) {
+        int neighbour = i < half ? previous : transition_out;
+        int32_t overlap = unity - pulse[i];
+        int64_t in_phase = pulse[i] + rotation_i[neighbour] * overlap;
+        int64_t quadrature = rotation_q[neighbour] * overlap;
+        int64_t carrier = in_phase * sineQ15(nco) - quadrature * sineQ15(nco - (1u << 30));
+        out[i] = (int16_t) (carrier / (2 * unity));
+        nco += phase_step_;
+    }
+}
 
-    PSK psk(filename, mode, symbol_rate);
-    psk.encodeTextData(message);
-    return 0;
-}
\ No newline at end of file
+/**
+ * @brief Returns the cached samples for a symbol, rendering them first if
+ * they have not been used yet.
+ * 
+ * @param templates Template cache to use
+ * @param length Length of the symbol in samples, samples_per_symbol_ or one more
+ * @param carrier_phase Carrier phase (in samples) at the start of the symbol
+ * @param phase The shift of the carrier wave in quarter turns [0 - 3]
+ * @param transition_in Phase shift from the previous symbol [0 - 3]
+ * @param transition_out Phase shift to the next symbol [0 - 3]
+ * @return const int16_t* 'length' samples, valid until the next template is
+ * rendered into the same cache
+ */
+const int16_t *PSK::getSymbolTemplate(SymbolTemplates &templates, int length,
+                                      int carrier_phase, int phase,
+                                      int transition_in, int transition_out) const {
+    int transitions; // The envelope only depends on whether there is a shift
+    if (pulse_shape_ == RAISED_COSINE) {
+        transitions = transition_in * 4 + transition_out;
+    } else {
+        transitions = (transition_in != 0) * 2 + (transition_out != 0);
+    }
+    int key = ((carrier_phase * 4 + phase) * transitionKeyCount() + transitions)
+              * symbolLengthCount() + (length - samples_per_symbol_);
+    int &offset = templates.index[key];
+    if (offset == -1) {
+        offset = templates.samples.size();
+        templates.samples.resize(offset + length);
+        renderSymbol(&templates.samples[offset], length, carrier_phase, phase,
+                     transition_in, transition_out);
+    }
+    return &templates.samples[offset];
+}
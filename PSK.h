@@ -21,8 +21,96 @@
 #include <math.h>
 #include <exception>
 #include <sstream>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+/**
+ * @brief Per stage timing and counters, see PSK::Stats. Build with
+ * -DPSK_STATS=0 to compile the instrumentation out entirely.
+ */
+#ifndef PSK_STATS
+#define PSK_STATS 1
+#endif
+
+class PSKStream;
+class ThreadPool;
+class ImaAdpcmEncoder;
+
+/**
+ * @brief Reads a bit stream (see PSK::bit_stream_) left to right with one bit
+ * of lookahead.
+ * @details The current and next word are held in a 64 bit register that is
+ * refilled whenever fewer than 33 bits are left in it, so the current bit and
+ * the lookahead bit are always the top two bits of the register.
+ */
+class BitStreamReader {
+    public:
+        BitStreamReader(const uint32_t *words, size_t num_words)
+            : words_(words), end_(words + num_words),
+              remaining_((uint64_t) num_words * 32) {
+            window_ = (uint64_t) (words_ < end_ ? *words_++ : 0) << 32;
+            window_ |= words_ < end_ ? *words_++ : 0;
+        }
+
+        bool empty() const { return remaining_ == 0; }
+
+        /** @brief The current bit [1, 0] */
+        int bit() const { return window_ >> 63; }
+
+        /** @brief The bit after the current bit [1, 0, -1] -1 = end of stream */
+        int nextBit() const {
+            return remaining_ > 1 ? (int) ((window_ >> 62) & 1) : -1;
+        }
+
+        void advance() {
+            window_ <<= 1;
+            remaining_--;
+            if (++consumed_ == 32) { // Low half is now empty, load next word
+                window_ |= words_ < end_ ? *words_++ : 0;
+                consumed_ = 0;
+            }
+        }
+
+        /**
+         * @brief True if the current bit starts a byte of the stream and
+         * the whole byte is left, see byte().
+         */
+        bool byteAligned() const { return (consumed_ & 7) == 0 && remaining_ >= 8; }
+
+        /** @brief The current bit and the 7 after it, current bit in the MSB */
+        unsigned byte() const { return window_ >> 56; }
+
+        /** @brief The bit after the current byte [1, 0, -1] -1 = end of stream */
+        int nextByteBit() const {
+            return remaining_ > 8 ? (int) ((window_ >> 55) & 1) : -1;
+        }
+
+        /** @brief Advances by a whole byte, only when byteAligned() */
+        void advanceByte() {
+            window_ <<= 8;
+            remaining_ -= 8;
+            consumed_ += 8;
+            if (consumed_ == 32) {
+                window_ |= words_ < end_ ? *words_++ : 0;
+                consumed_ = 0;
+            }
+        }
+
+    private:
+        const uint32_t *words_; // Next word to load
+        const uint32_t *end_;
+        uint64_t remaining_; // Bits left to read
+        uint64_t window_;
+        int consumed_ = 0; // Bits consumed since the last refill
+};
 
 class PSK {
+    friend class PSKStream;
+    friend class PSKDemodulator; // Loopback decoder, see PSKDemodulator.h
+    friend class PSKMultiplex; // Writes the mix with the wav file output
+    friend class PSKBench; // Benchmarks of the private stages, see PSKBench.cpp
+
     public:
         enum Mode { 
             BPSK,
@@ -38,52 +126,256 @@ class PSK {
             S1000
         };
 
+        enum PulseShape {
+            ENVELOPE, // cos^2 envelope at phase changes (original)
+            RAISED_COSINE // Raised cosine pulse filter at baseband
+        };
+
+        /**
+         * @brief Sample format of wav files and streams. The audio is always
+         * rendered as 16 bit samples and converted on output.
+         */
+        enum SampleFormat {
+            PCM16, // 16 bit signed PCM (default)
+            PCM8, // 8 bit unsigned PCM, half the size
+            FLOAT32, // 32 bit IEEE float, the 16 bit samples exactly
+            IMA_ADPCM // 4 bit IMA ADPCM, a quarter of the size
+        };
+
+        /**
+         * @brief Receives blocks of rendered samples when encoding to a
+         * callback instead of a wav file.
+         */
+        using SampleCallback = std::function<void(const int16_t *samples, int count)>;
+
+        /**
+         * @brief Output and framing settings. The defaults match the PSK31
+         * convention used by fldigi (44.1 kHz, 1500 Hz carrier).
+         */
+        static constexpr int max_sample_rate = 192000; // Hz
+
+        struct Config {
+            int sample_rate = 44100; // Hz, e.g. 8000, 12000, 44100, 48000
+            int bits_per_sample = 16; // Rendering resolution, only 16 is supported
+            SampleFormat sample_format = PCM16; // Wav file and stream output format
+            int carrier_freq = 1500; // Hz, must be below sample_rate / 2
+            int preamble_length = 64; // symbols
+            int postamble_length = 64; // symbols
+        };
+
+        /**
+         * @brief Optional framing of encodeRawData(). Both fields are 16 bit,
+         * MSB first, like the data.
+         */
+        struct RawFraming {
+            RawFraming() : length_prefix(false), crc(false) {}
+            bool length_prefix; // Number of data bytes before the data
+            bool crc; // CRC-16/CCITT-FALSE of the prefix and data after it
+        };
+
+        /**
+         * @brief Timing and counters accumulated over every encode since the
+         * last resetStats(). Only recorded while enabled with setStats().
+         * @details modulation_seconds excludes the time spent in I/O (writes,
+         * flushes, sample callbacks, wav headers and finalizing the file),
+         * which is io_seconds. bytes_written counts what went to a wav file,
+         * stream or callback, not samples appended to a vector.
+         */
+        struct Stats {
+            double bit_stream_seconds = 0; // Preamble, varicode and postamble
+            double modulation_seconds = 0; // Symbol mapping and rendering
+            double io_seconds = 0;
+            long long symbols = 0;
+            long long samples = 0; // Audio samples, or I/Q pairs
+            long long bytes_written = 0;
+            long long reused_samples = 0; // Copied from the incremental cache
+            size_t peak_buffer_bytes = 0; // Bit stream, output buffer, templates, CW ID
+        };
+
         PSK(std::string file_path, Mode mode, SymbolRate sym_rate);
         PSK(std::string fuile_path, Mode mode, SymbolRate sym_rate, std::string call_sign);
+        PSK(std::string file_path, Mode mode, SymbolRate sym_rate, const Config &config);
         ~PSK();
 
-        bool encodeTextData(std::string message);
-        bool encodeRawData(unsigned char *data, int length);
+        void setup(Mode mode, SymbolRate baud);
+        void setup(Mode mode, SymbolRate baud, const Config &config);
+        void reset();
+        const Config &config() const;
+
+        bool encodeTextData(const std::string &message);
+        bool encodeTextData(const std::string &message, std::vector<int16_t> &out);
+        bool encodeTextData(const std::string &message, SampleCallback callback);
+        bool encodeTextData(const std::string &message, std::ostream &out,
+                            bool wav_header = true);
+        bool encodeTextDataIQ(const std::string &message, int oversampling = 8);
+        bool encodeTextDataIQ(const std::string &message, std::vector<int16_t> &out,
+                              int oversampling = 8);
+        bool encodeTextDataIQ(const std::string &message, std::vector<float> &out,
+                              int oversampling = 8);
+        bool beginTextData(int idle_length = 32);
+        bool appendTextData(const std::string &message);
+        bool endTextData();
+        bool encodeRawData(const unsigned char *data, int length,
+                           const RawFraming &framing = RawFraming());
+        bool encodeRawData(const unsigned char *data, int length,
+                           std::vector<int16_t> &out,
+                           const RawFraming &framing = RawFraming());
+        bool encodeRawData(const unsigned char *data, int length,
+                           SampleCallback callback,
+                           const RawFraming &framing = RawFraming());
+        bool encodeRawData(const unsigned char *data, int length, std::ostream &out,
+                           bool wav_header = true,
+                           const RawFraming &framing = RawFraming());
         void dumpBitStream();
-        
+        void setOutputChunkSize(int samples);
+        void setFilePath(std::string file_path);
+        void setCallSign(std::string call_sign);
+        void setFixedPoint(bool enabled);
+        void setVectorized(bool enabled);
+        void setPulseShape(PulseShape shape);
+        void setSymbolTemplates(bool enabled);
+        void setThreads(int threads);
+        void setIncremental(bool enabled);
+        void setMemoryMapped(bool enabled);
+        void setStats(bool enabled);
+        const Stats &stats() const;
+        void resetStats();
+
 
     private:
         // Configuration
-        void setup(Mode mode, SymbolRate baud);
         const int morse_frequency_ = 600;
         const int morse_dit_length_ = 100; // milliseconds
         const int morse_dah_length_ = 300; // milliseconds
+        const int morse_rise_time_ = 5; // milliseconds, keying envelope edges
         
-        const int preamble_length_ = 64; // symbols
-        const int postamble_length_ = 64; // symbols
+        Config config_;
+        int preamble_length_; // symbols
+        int postamble_length_; // symbols
 
         std::string file_path_;
         Mode mode_;
         bool morse_callsign_;
         std::string call_sign_;
 
+        /**
+         * @details CW ID. The callsign is keyed once per encoder (and again
+         * only after setCallSign() or setup()) into call_sign_samples_: the
+         * keyed callsign followed by a word space of silence. It is copied
+         * to the output before the PSK body and, with the word space first,
+         * after it, so every transmission is identified without being
+         * resynthesized.
+         */
+        std::vector<int16_t> call_sign_samples_;
+        int call_sign_gap_ = 0; // Samples of silence at the end of call_sign_samples_
+        const std::vector<int16_t> &callSignSamples();
+        void renderCallSign();
+        void addCallSign(bool leading);
+        void encodeTransmission();
+        long long transmissionSampleCount();
+
+
+        // Output members and methods
+        enum OutputTarget {
+            WAV_FILE,
+            SAMPLE_VECTOR,
+            SAMPLE_CALLBACK,
+            OUTPUT_STREAM,
+            MAPPED_FILE
+        };
+
+        void resetState();
+
+        // Transmission built with beginTextData()/appendTextData()/endTextData()
+        bool appending_ = false;
+        int append_idle_length_ = 0; // symbols
+        int appended_messages_ = 0;
+        void buildTextBitStream(const std::string &message);
+        void buildRawBitStream(const unsigned char *data, int length,
+                               const RawFraming &framing);
+        static uint16_t crc16(uint16_t crc, const unsigned char *data, int length);
+        size_t textBitStreamWords(const std::string &message) const;
+        long long bitStreamSampleCount() const;
+
+        OutputTarget output_target_ = WAV_FILE;
+        std::vector<int16_t> *sample_vector_ = nullptr;
+        SampleCallback sample_callback_;
+        std::ostream *output_stream_ = nullptr;
+        class OutputGuard; // Restores the output target, see PSK.cpp
+        bool encodeToFile();
+        bool encodeToVector(std::vector<int16_t> &out);
+        bool encodeToCallback(SampleCallback callback);
+        bool encodeToStream(std::ostream &out, bool wav_header);
+
+        /**
+         * @details Memory mapped wav output. The file is sized for the whole
+         * bit stream before encoding, so samples are reserved straight from
+         * the mapping.
+         */
+        bool encodeToMappedFile();
+        bool memory_mapped_ = true;
+        int16_t *mapped_samples_ = nullptr;
+        long long mapped_capacity_ = 0; // samples
+        long long mapped_fill_ = 0; // samples
 
         // WAV file members and methods
         bool openFile(std::string file_path);
         void writeHeader();
+        void writeHeader(int sample_rate, int channels);
+        void writeHeader(std::ostream &out, int sample_rate, int channels,
+                         uint32_t data_size, SampleFormat format,
+                         uint32_t frames) const;
+        static constexpr int max_wav_header_size_ = 60; // bytes, see wavHeaderSize()
+        static int wavHeaderSize(SampleFormat format);
+        int formatHeader(char *header, int sample_rate, int channels,
+                         uint32_t data_size, SampleFormat format,
+                         uint32_t frames) const;
         void writeBytes(int data, int size);
+        static void writeBytes(std::ostream &out, uint32_t data, int size);
         void finalizeFile();
-        void addCallSign();
+        int16_t *reserveSamples(int count);
+        void commitSamples(int count);
+        void flushSamples();
+
+        /**
+         * @details Output format conversion. output_format_ is the format of
+         * the wav file or stream being written (16 bit for I/Q files). Every
+         * chunk is converted into format_buffer_ by the kernels in
+         * PSKFormat.h when it is flushed, the IMA ADPCM encoder keeps its
+         * state and partial block from one chunk to the next.
+         */
+        SampleFormat output_format_ = PCM16;
+        std::vector<uint8_t> format_buffer_;
+        std::unique_ptr<ImaAdpcmEncoder> adpcm_encoder_;
+        void startFormattedOutput(SampleFormat format);
+        long long writeFormatted(std::ostream &out, const int16_t *samples, int count);
+        long long finishFormattedOutput(std::ostream &out);
         
-        const int sample_rate_ = 44100; // Sample rate of the WAV file in Hz (44100)
-        const int bits_per_sample_ = 16;
-        const int max_amplitude_ = pow(2, bits_per_sample_ - 1) - 1;
+        int sample_rate_; // Sample rate of the WAV file in Hz (44100)
+        int bits_per_sample_;
+        int max_amplitude_; // pow(2, bits_per_sample_ - 1) - 1
         std::ofstream wav_file_; // File descriptor for the WAV file
         int data_start_;
 
+        /**
+         * @details Samples are rendered into sample_buffer_ and written to the
+         * wav file (or passed to the sample callback) once output_chunk_size_
+         * samples have accumulated, or when encoding finishes, instead of one
+         * stream write per sample. When encoding to a sample vector, samples
+         * are rendered directly into the vector instead.
+         */
+        int output_chunk_size_ = 8192; // samples
+        std::vector<int16_t> sample_buffer_;
+        int sample_buffer_fill_ = 0;
+
         // Bit Stream members and methods
         void addVaricode(char c);
-        void addBits(unsigned char *data, int num_bits);
+        void addBits(const unsigned char *data, int num_bits);
+        void appendBits(uint32_t bits, int num_bits);
         void pushBufferToBitStream();
         void addPreamble();
+        void addIdle(int symbols);
         void addPostamble();
-        int popNextBit();
-        int peakNextBit();
         
         /**
          * @details Bit stream is an array of 32 bit integers.
@@ -101,32 +393,275 @@ class PSK {
          * 
          * Although this may not be the best way to store the bit stream,
          * it makes it easier to understand.
+         * 
+         * The vector is the encoder's bit stream arena: it is reserved for
+         * the exact length of a message before it is built (see
+         * textBitStreamWords()) and keeps its capacity between messages, so
+         * an encoder that is reused (like the per worker encoders of
+         * PSKBatch) does not allocate once it has seen its longest message.
          */
         std::vector<uint32_t> bit_stream_;
-        int bit_stream_index_ = 0;
-        uint32_t bit_stream_buffer_ = 0;
-        int bit_stream_offset_ = 0; // Write left to right. [0 - 31]
+        uint64_t bit_stream_buffer_ = 0; // Accumulator, newest bit is the LSB
+        int bit_stream_offset_ = 0; // Bits pending in the accumulator [0 - 31]
 
         // Modulation members and methods
+        /**
+         * @brief The phase of one symbol and the phase shift to the next one.
+         */
+        struct Symbol {
+            uint8_t phase; // Quarter turns [0 - 3]
+            uint8_t transition; // Shift to the next symbol [0 - 3]
+        };
+
+        /**
+         * @brief BPSK/QPSK encoder state carried from one symbol to the next.
+         */
+        struct EncoderState {
+            int last_phase = 0; // BPSK phase state, 0 = 0, 1 = M_PI
+            int symbol_phase = 0; // QPSK phase in quarter turns [0 - 3]
+            unsigned char conv_code_buffer = 0; // QPSK last 5 bits
+        };
+
+        /**
+         * @details Symbol template cache. Every symbol is fully determined by
+         * the carrier phase at its start, its phase shift (quarter turns),
+         * whether its start and end are filtered and its length. Templates are rendered once
+         * with renderSymbol() the first time they are needed and then copied
+         * to the output. If the table could grow larger than
+         * symbol_template_limit_ samples, every symbol is rendered directly.
+         */
+        struct SymbolTemplates {
+            bool enabled = false;
+            std::vector<int> index; // offset or -1 if not rendered
+            std::vector<int16_t> samples;
+        };
+
+        /**
+         * @brief Modulator state at a word boundary of the bit stream:
+         * everything the audio of the following symbols depends on besides
+         * their bits.
+         */
+        struct ModulatorState {
+            EncoderState encoder;
+            int carrier_phase;
+            int symbol_clock;
+            int last_transition;
+        };
+        ModulatorState modulatorState() const;
+        void restoreModulatorState(const ModulatorState &state);
+        static bool sameModulatorState(const ModulatorState &a, const ModulatorState &b);
+
         void encodeBitStream();
-        void addSymbol(double shift, int next_shift);
+        void encodeBitStream(size_t words);
+        void modulateBitStream(size_t words);
+        template <Mode M, int SamplesPerSymbol> friend class PSKModulator;
+        void (*modulator_)(PSK &psk, size_t first_word, size_t last_word,
+                           ModulatorState *checkpoints) = nullptr; // Serial loop, see PSKModulator.h
+        bool encodeBitStreamParallel(size_t num_words);
+        size_t mapSymbols(EncoderState &state, BitStreamReader &reader,
+                          Symbol *symbols, size_t max_symbols) const;
+        void mapSymbol(EncoderState &state, int bit, int next_bit, int &phase,
+                       int &transition) const;
+        void writeSamples(const int16_t *samples, long long count);
+        void renderBaseband(int oversampling, std::vector<float> &out);
+        const int16_t *nextSymbolSamples(int phase, int transition,
+                                         int16_t *scratch, int &length);
+        const int16_t *symbolSamples(SymbolTemplates &templates, int length,
+                                     int carrier_phase, int phase,
+                                     int transition_in, int transition_out,
+                                     int16_t *scratch) const;
+        void renderSymbol(int16_t *out, int length, int carrier_phase, int phase,
+                          int transition_in, int transition_out) const;
+        void renderSymbolFloat(int16_t *out, int length, int carrier_phase,
+                               int phase, int filter_start, int filter_end) const;
+        void renderSymbolFixed(int16_t *out, int length, int carrier_phase,
+                               int phase, int filter_start, int filter_end) const;
+        void renderSymbolSimd(int16_t *out, int length, int carrier_phase,
+                              int phase, int filter_start, int filter_end) const;
+        void renderShapedFloat(int16_t *out, int length, int carrier_phase,
+                               int phase, int transition_in, int transition_out) const;
+        void renderShapedFixed(int16_t *out, int length, int carrier_phase,
+                               int phase, int transition_in, int transition_out) const;
+        const int16_t *getSymbolTemplate(SymbolTemplates &templates, int length,
+                                         int carrier_phase, int phase,
+                                         int transition_in, int transition_out) const;
+        int transitionKeyCount() const;
+        int symbolLengthCount() const;
+        int pulseTableOffset(int length) const;
+        void clearSymbolTemplates();
+        void resetSymbolTemplates(SymbolTemplates &templates) const;
 
-        double symbol_rate_; // Symbol rate of the PSK modulation in Sym/s (125, 250, 500)
-        int carrier_freq_ = 1500; // Carrier frequency in Hz (1500)
+        double symbol_rate_; // Symbol rate of the PSK modulation in Sym/s (31.25 - 1000)
+        int carrier_freq_; // Carrier frequency in Hz (1500)
         int samples_per_symbol_; // floor(sample_rate_ / symbol_rate_)
 
-        double carrier_wave_angle_ = 0.0f;
+        /**
+         * @details Symbol clock. sample_rate_ / symbol_rate_ is rarely a whole
+         * number (352.8 at 44.1 kHz and 125 Sym/s), so symbols are
+         * samples_per_symbol_ or samples_per_symbol_ + 1 samples long. The
+         * clock is a Bresenham accumulator in units of 1 / symbol_clock_modulus_
+         * samples (quarter Sym/s, so 31.25 and 62.5 Sym/s are exact): a
+         * symbol is one sample longer whenever the fraction wraps. Symbol k
+         * starts exactly at sample floor(k * sample_rate_ / symbol_rate_), so
+         * there is no drift however long the transmission is.
+         */
+        int symbol_clock_modulus_; // symbol_rate_ * 4
+        int symbol_clock_fraction_; // sample_rate_ * 4 % symbol_clock_modulus_
+        int symbol_clock_ = 0; // [0 - symbol_clock_modulus_)
+        int nextSymbolLength(int &clock) const;
+        long long symbolClockSamples(int clock, long long symbols) const;
+        int symbolClockAfter(int clock, long long symbols) const;
+
+        /**
+         * @details The carrier is tracked as an integer sample index into
+         * one carrier period instead of an accumulated angle. A period is
+         * sample_rate_ / gcd(sample_rate_, carrier_freq_) samples long (147 at
+         * 44.1 kHz and 1500 Hz), so the carrier phase at the start of a symbol
+         * can only take that many values.
+         */
+        int carrier_period_; // Samples before the carrier repeats exactly
+        int carrier_phase_ = 0; // [0 - carrier_period_)
         double angle_delta_;
-        int last_symbol_end_filtered_ = 1;
-        
-        int last_bit_ = 0;
-        unsigned char conv_code_buffer_ = 0;
+        int last_transition_ = 2; // Shift into the next symbol, 2 = from silence
+
+        /**
+         * @details Fixed point renderer. The carrier is a 32 bit phase
+         * accumulator that indexes quarter_sine_q15 and the pulse shape is
+         * precomputed in Q15 (32768 = 1.0) with the same table, so the output
+         * only depends on integer arithmetic and is identical on every
+         * platform, including ones without an FPU.
+         */
+        bool fixed_point_ = false;
+        uint32_t phase_step_; // round(2^32 * carrier_freq_ / sample_rate_)
+        std::vector<int32_t> filter_shape_q15_; // Filtered envelope per sample
+
+        /**
+         * @details The pulse tables below (and filter_shape_q15_) hold the
+         * table for samples_per_symbol_ long symbols followed by the one for
+         * samples_per_symbol_ + 1 long symbols, see pulseTableOffset().
+         */
+
+        /**
+         * @details Vectorized renderer (see PSKSimd.h), used for symbols that
+         * are rendered directly because the template cache is disabled.
+         * envelope_ holds amplitude * filter * max_amplitude_ for each of the
+         * four filtered/unfiltered start/end combinations.
+         */
+        bool vectorized_ = true;
+        std::vector<float> envelope_; // [length][filter_start * 2 + filter_end][sample]
+
+        /**
+         * @details Raised cosine pulse shaping. Every symbol is a cos^2 pulse
+         * two symbols long, centred on the symbol, so within one symbol only
+         * it and one neighbour overlap. pulse_ is the symbol's own pulse and
+         * pulse_overlap_ the neighbour's (they always sum to 1, so there is no
+         * amplitude change without a phase change).
+         */
+        PulseShape pulse_shape_ = ENVELOPE;
+        std::vector<double> pulse_;
+        std::vector<double> pulse_overlap_;
+        std::vector<int32_t> pulse_q15_; // Fixed point pulse_, overlap = 1 - pulse
+
+        bool use_symbol_templates_ = true;
+        const int symbol_template_limit_ = 1 << 23; // samples (16 MiB)
+        SymbolTemplates symbol_templates_;
+
+        EncoderState encoder_;
+
+        /**
+         * @details Parallel encoding. The bit stream is split into chunks of
+         * whole words, the encoder state at the start of every chunk is found
+         * with a prefix scan (BPSK phase = parity of the 0 bits before it,
+         * QPSK phase = sum of the convolutional code shifts before it, carrier
+         * phase from the symbol index) and the chunks are rendered on the
+         * pool, each worker with its own template cache. The output is
+         * identical to the serial encoder.
+         */
+        std::unique_ptr<ThreadPool> thread_pool_;
+        std::vector<SymbolTemplates> worker_templates_;
+        const int parallel_min_words_ = 64; // Smallest chunk (2048 symbols)
+
+        /**
+         * @details Incremental re-encode cache, see setIncremental(). Holds
+         * the bit stream and audio of the last body with the modulator state
+         * before every word. A new body only renders the words from the one
+         * before the first changed word (its last symbol looks ahead into the
+         * changed word) up to the common tail of both bit streams. The audio
+         * of the tail is copied too if the modulator state has come back to
+         * the state the last body had there (same BPSK/QPSK phase, carrier
+         * phase and symbol clock). The body is edited in place and only the
+         * tail is copied aside, so nothing is allocated once the cache has
+         * seen its longest body.
+         */
+        struct IncrementalCache {
+            bool enabled = false;
+            bool valid = false;
+            std::vector<uint32_t> bit_stream;
+            std::vector<int16_t> samples;
+            std::vector<ModulatorState> checkpoints; // One per word, and the end
+            std::vector<int16_t> tail_samples; // Old tail while the span is rendered
+            std::vector<ModulatorState> tail_checkpoints;
+        };
+        IncrementalCache incremental_;
+        void encodeBitStreamIncremental();
+
+        // Instrumentation, see Stats
+        void updatePeakBufferBytes();
+        bool stats_enabled_ = false;
+        Stats stats_;
 };
 
 
 
 #endif // PSK_H_
 
+#ifndef QUARTER_SINE_H_
+#define QUARTER_SINE_H_
+/**
+ * @brief Number of entries in a quarter wave of the fixed point sine table. The
+ * table has one more entry so that sin(90 degrees) is included.
+ */
+constexpr int quarter_sine_size = 1024;
+
+struct QuarterSineTable {
+    int16_t values[quarter_sine_size + 1];
+};
+
+/**
+ * @brief Builds the quarter wave sine table in Q15 at compile time from a
+ * Taylor series, so it does not depend on the platform's libm.
+ */
+constexpr QuarterSineTable makeQuarterSineTable() {
+    QuarterSineTable table = {};
+    for (int i = 0; i <= quarter_sine_size; i++) {
+        double x = (M_PI / 2.0) * i / quarter_sine_size;
+        double term = x;
+        double sum = x;
+        for (int n = 1; n < 12; n++) {
+            term *= -x * x / ((2 * n) * (2 * n + 1));
+            sum += term;
+        }
+        table.values[i] = (int16_t) (sum * 32767.0 + 0.5);
+    }
+    return table;
+}
+
+constexpr QuarterSineTable quarter_sine_q15 = makeQuarterSineTable();
+
+/**
+ * @brief Sine of a 32 bit phase word (2^32 = 360 degrees) in Q15, from the
+ * quarter wave table. Uses the top 12 bits of the phase.
+ */
+constexpr int32_t sineQ15(uint32_t phase) {
+    uint32_t index = (phase + (1u << 19)) >> 20; // Round to 12 bits
+    uint32_t quadrant = (index >> 10) & 3;
+    uint32_t offset = index & (quarter_sine_size - 1);
+    int32_t value = quadrant & 1 ? quarter_sine_q15.values[quarter_sine_size - offset]
+                                 : quarter_sine_q15.values[offset];
+    return quadrant & 2 ? -value : value;
+}
+#endif // QUARTER_SINE_H_
+
 #ifndef VARICODE_H_
 #define VARICODE_H_
 /**
@@ -134,7 +669,7 @@ class PSK {
  * @brief A lookup table for converting char -> varicode string.
  * Supports all ASCII control characters and printable characters 0-127.
  */
-const uint16_t ascii_to_varicode[128] = {
+constexpr uint16_t ascii_to_varicode[128] = {
     // ASCII Control Characters (0 - 31)
     0b1010101011, // 0	    [NUL]	Null character
     0b1011011011, // 1	    [SOH]	Start of Header
@@ -268,6 +803,41 @@ const uint16_t ascii_to_varicode[128] = {
     0b1110110101  //	127	[DEL]
 };
 
+/**
+ * @brief A varicode with the two 0 bit character separator appended,
+ * right aligned in 'bits', and its length including the separator.
+ */
+struct VaricodeWord {
+    uint16_t bits;
+    uint8_t length;
+};
+
+constexpr VaricodeWord makeVaricodeWord(uint16_t varicode) {
+    uint8_t length = 0;
+    while (varicode >> length) {
+        length++;
+    }
+    return {(uint16_t) (varicode << 2), (uint8_t) (length + 2)};
+}
+
+struct VaricodeTable {
+    VaricodeWord words[128];
+};
+
+constexpr VaricodeTable makeVaricodeTable() {
+    VaricodeTable table = {};
+    for (int i = 0; i < 128; i++) {
+        table.words[i] = makeVaricodeWord(ascii_to_varicode[i]);
+    }
+    return table;
+}
+
+/**
+ * @brief A lookup table for converting char -> varicode with separator, so
+ * each character can be appended to the bit stream in one step.
+ */
+constexpr VaricodeTable varicode_words = makeVaricodeTable();
+
 /**
  * @brief An unordered_map to convert a string representation of varicode
  * to a char. Supports all Varicode/ASCII characters 0-127.
@@ -411,42 +981,91 @@ static std::unordered_map<std::string, int> varicode_to_ascii = {
 #define CONVOLUTIONAL_H_
 /**
  * @brief Convolutional Code. Left shifting 5 bit values mapped to their
- * respective phase shift values in degrees. Supports all binary values
- * 0x00 to 0x1F.
+ * respective phase shift values in quarter turns (1 = 90 degrees,
+ * 2 = 180 degrees, 3 = -90 degrees). Supports all binary values 0x00 to 0x1F.
  * @cite http://www.arrl.org/psk31-spec
  */
-std::map <unsigned char, double> conv_code = {
-    {0b00000, M_PI},
-    {0b00001, M_PI/2.0 },
-    {0b00010, -(M_PI/2.0)},
-    {0b00011, 0  },
-    {0b00100, -(M_PI/2.0)},
-    {0b00101, 0  },
-    {0b00110, M_PI},
-    {0b00111, M_PI/2.0 },
-    {0b01000, 0  },
-    {0b01001, -(M_PI/2.0)},
-    {0b01010, M_PI/2.0 },
-    {0b01011, M_PI},
-    {0b01100, M_PI/2.0 },
-    {0b01101, M_PI},
-    {0b01110, 0 },
-    {0b01111, -(M_PI/2.0)},
-    {0b10000, M_PI/2.0 },
-    {0b10001, M_PI},
-    {0b10010, 0  },
-    {0b10011, -(M_PI/2.0)},
-    {0b10100, 0  },
-    {0b10101, -(M_PI/2.0)},
-    {0b10110, M_PI/2.0 },
-    {0b10111, M_PI},
-    {0b11000, -(M_PI/2.0)},
-    {0b11001, 0  },
-    {0b11010, M_PI},
-    {0b11011, M_PI/2.0 },
-    {0b11100, M_PI},
-    {0b11101, M_PI/2.0 },
-    {0b11110, -(M_PI/2.0)},
-    {0b11111, 0  }
+constexpr unsigned char conv_code[32] = {
+    2, // 0b00000
+    1, // 0b00001
+    3, // 0b00010
+    0, // 0b00011
+    3, // 0b00100
+    0, // 0b00101
+    2, // 0b00110
+    1, // 0b00111
+    0, // 0b01000
+    3, // 0b01001
+    1, // 0b01010
+    2, // 0b01011
+    1, // 0b01100
+    2, // 0b01101
+    0, // 0b01110
+    3, // 0b01111
+    1, // 0b10000
+    2, // 0b10001
+    0, // 0b10010
+    3, // 0b10011
+    0, // 0b10100
+    3, // 0b10101
+    1, // 0b10110
+    2, // 0b10111
+    3, // 0b11000
+    0, // 0b11001
+    2, // 0b11010
+    1, // 0b11011
+    2, // 0b11100
+    1, // 0b11101
+    3, // 0b11110
+    0  // 0b11111
+};
+#endif // CONVOLUTIONAL_H_
+#ifndef MORSE_H_
+#define MORSE_H_
+/**
+ * @brief International Morse code of the characters that can be sent in a
+ * CW ID ('.' = dit, '-' = dah). Letters are upper case only, see morse_code.
+ */
+struct MorseCharacter {
+    char character;
+    const char *code;
+};
+
+constexpr MorseCharacter morse_characters[] = {
+    {'A', ".-"},    {'B', "-..."},  {'C', "-.-."},  {'D', "-.."},
+    {'E', "."},     {'F', "..-."},  {'G', "--."},   {'H', "...."},
+    {'I', ".."},    {'J', ".---"},  {'K', "-.-"},   {'L', ".-.."},
+    {'M', "--"},    {'N', "-."},    {'O', "---"},   {'P', ".--."},
+    {'Q', "--.-"},  {'R', ".-."},   {'S', "..."},   {'T', "-"},
+    {'U', "..-"},   {'V', "...-"},  {'W', ".--"},   {'X', "-..-"},
+    {'Y', "-.--"},  {'Z', "--.."},
+    {'0', "-----"}, {'1', ".----"}, {'2', "..---"}, {'3', "...--"},
+    {'4', "....-"}, {'5', "....."}, {'6', "-...."}, {'7', "--..."},
+    {'8', "---.."}, {'9', "----."},
+    {'/', "-..-."}, {'-', "-....-"}, {'.', ".-.-.-"}, {',', "--..--"},
+    {'?', "..--.."}, {'=', "-...-"}
 };
-#endif // CONVOLUTIONAL_H_
\ No newline at end of file
+
+/**
+ * @brief ASCII -> Morse code lookup table. Each code is packed MSB first
+ * behind a leading 1 bit (1 = dah, 0 = dit), so ".-" is 0b101. 0 = the
+ * character has no Morse code.
+ */
+struct MorseTable {
+    uint8_t codes[128];
+};
+
+constexpr MorseTable makeMorseTable() {
+    MorseTable table = {};
+    for (const MorseCharacter &morse : morse_characters) {
+        uint8_t code = 1;
+        for (const char *element = morse.code; *element; element++) {
+            code = (code << 1) | (*element == '-');
+        }
+        table.codes[(int) morse.character] = code;
+    }
+    return table;
+}
+
+constexpr MorseTable morse_code = makeMorseTable();
+#endif // MORSE_H_
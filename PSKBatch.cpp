@@ -0,0 +1,110 @@
+/**
+ * @file PSKBatch.cpp
+ * @brief Implementation of the batch encoder
+ * @date 2026-10-14
+ * @copyright Copyright (c) 2022
+ * @version 0.1
+ */
+
+#include "PSKBatch.h"
+
+/**
+ * @brief Construct a batch encoder.
+ * @param threads Number of worker threads, must be at least 1
+ */
+PSKBatch::PSKBatch(int threads) : encoders_(threads) {
+    pool_.reset(new ThreadPool(threads));
+}
+
+/**
+ * @brief Waits for all submitted jobs to finish.
+ */
+PSKBatch::~PSKBatch() {
+    pool_.reset(); // Joins the workers before the encoders are destroyed
+}
+
+/**
+ * @brief Queues a job.
+ * @param job 
+ * @param on_complete Optional, called on the worker thread when the job is
+ * done (before the future becomes ready). If it throws, the result reports
+ * the error instead.
+ * @return std::future<Result> 
+ */
+std::future<PSKBatch::Result> PSKBatch::submit(Job job, CompletionCallback on_complete) {
+    std::shared_ptr<std::promise<Result>> promise(new std::promise<Result>());
+    std::future<Result> future = promise->get_future();
+
+    pool_->submit([this, job, on_complete, promise](int worker) {
+        Result result;
+        try {
+            PSK &psk = encoder(worker, job);
+            if (job.file_path.empty()) {
+                result.success = psk.encodeTextData(job.message, result.samples);
+            } else {
+                psk.setFilePath(job.file_path);
+                result.success = psk.encodeTextData(job.message);
+            }
+        } catch (const std::exception &e) {
+            result.success = false;
+            result.error = e.what();
+        } catch (...) { // Every job fulfils its promise
+            result.success = false;
+            result.error = "Encoding failed";
+        }
+        if (on_complete) {
+            try { // The future is fulfilled even if the callback throws
+                on_complete(job, result);
+            } catch (const std::exception &e) {
+                result.success = false;
+                result.error = std::string("Completion callback failed: ") + e.what();
+            } catch (...) {
+                result.success = false;
+                result.error = "Completion callback failed";
+            }
+        }
+        promise->set_value(std::move(result));
+    });
+    return future;
+}
+
+/**
+ * @brief Queues a list of jobs.
+ * @param jobs 
+ * @return std::vector<std::future<Result>> One future per job, in order
+ */
+std::vector<std::future<PSKBatch::Result>> PSKBatch::submit(const std::vector<Job> &jobs) {
+    std::vector<std::future<Result>> futures;
+    futures.reserve(jobs.size());
+    for (const Job &job : jobs) {
+        futures.push_back(submit(job));
+    }
+    return futures;
+}
+
+/**
+ * @brief Returns the worker's encoder for the job's mode, symbol rate,
+ * config and callsign, creating it the first time it is needed and
+ * dropping the least recently used one if the worker has too many.
+ */
+PSK &PSKBatch::encoder(int worker, const Job &job) {
+    const PSK::Config &config = job.config;
+    EncoderKey key(job.mode, job.symbol_rate, config.sample_rate,
+                   config.bits_per_sample, config.carrier_freq,
+                   config.preamble_length, config.postamble_length,
+                   config.sample_format, job.call_sign);
+    EncoderList &encoders = encoders_[worker];
+    for (auto it = encoders.begin(); it != encoders.end(); ++it) {
+        if (it->first == key) {
+            encoders.splice(encoders.begin(), encoders, it); // Most recent first
+            return *encoders.front().second;
+        }
+    }
+    std::unique_ptr<PSK> psk(new PSK("", job.mode, job.symbol_rate, config));
+    psk->setCallSign(job.call_sign);
+    if (encoders.size() >= max_encoders) {
+        encoders.pop_back();
+    }
+    encoders.emplace_front(key, std::move(psk));
+    return *encoders.front().second;
+}
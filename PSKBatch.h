@@ -0,0 +1,73 @@
+/**
+ * @file PSKBatch.h
+ * @brief Header file that defines the PSKBatch class, which encodes many
+ * messages concurrently on a shared work stealing thread pool.
+ * @date 2026-10-14
+ * @copyright Copyright (c) 2022
+ * @version 0.1
+ */
+
+#ifndef PSK_BATCH_H_
+#define PSK_BATCH_H_
+
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "PSK.h"
+#include "ThreadPool.h"
+
+class PSKBatch {
+    public:
+        /**
+         * @brief One message to encode. If file_path is empty the samples are
+         * returned in the Result instead of being written to a wav file.
+         */
+        struct Job {
+            std::string message;
+            PSK::Mode mode = PSK::BPSK;
+            PSK::SymbolRate symbol_rate = PSK::S125;
+            std::string file_path;
+            PSK::Config config;
+            std::string call_sign; // CW ID before and after, empty for none
+        };
+
+        struct Result {
+            bool success = false;
+            std::string error; // Set if success is false
+            std::vector<int16_t> samples; // Only for jobs without a file path
+        };
+
+        using CompletionCallback = std::function<void(const Job &job, const Result &result)>;
+
+        explicit PSKBatch(int threads);
+        ~PSKBatch();
+
+        std::future<Result> submit(Job job, CompletionCallback on_complete = nullptr);
+        std::vector<std::future<Result>> submit(const std::vector<Job> &jobs);
+
+    private:
+        PSK &encoder(int worker, const Job &job);
+
+        /**
+         * @details Encoders are kept per worker and per mode/symbol rate/
+         * config/callsign, so their symbol templates, buffers and keyed CW ID
+         * are reused by every job that the worker runs. Each worker keeps
+         * the max_encoders most recently used ones, most recent first, so
+         * jobs with ever new settings (a daemon's clients pick the sample
+         * rate and carrier) can not grow the memory without bound. Only the
+         * owning worker touches its list.
+         */
+        static constexpr size_t max_encoders = 8; // Per worker
+        using EncoderKey = std::tuple<int, int, int, int, int, int, int, int, std::string>;
+        using EncoderList = std::list<std::pair<EncoderKey, std::unique_ptr<PSK>>>;
+        std::vector<EncoderList> encoders_;
+        std::unique_ptr<ThreadPool> pool_;
+};
+
+#endif // PSK_BATCH_H_
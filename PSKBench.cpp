@@ -0,0 +1,284 @@
+/**
+ * @file PSKBench.cpp
+ * @brief Google Benchmark suite for the modulator hot paths
+ * @details
+ * Build with 'make bench' and run ./psk_bench. Measures:
+ * - addVaricode() throughput (characters/s) and addBits() throughput
+ * - encodeBitStream() symbols/s for every mode and symbol rate
+ * - mapSymbols() symbols/s, the BPSK/QPSK mapping without rendering
+ * - encodeBitStream() with fixed point rendering and no template cache
+ * - encodeTextData() end to end samples/s for every mode and symbol rate,
+ *   plus the bytes allocated per message
+ * - encodeTextData() of a changing beacon with and without setIncremental()
+ * - PSKDemodulator loopback samples/s and bit errors of every renderer
+ * 
+ * Arguments are {mode, symbol rate} as the PSK::Mode and PSK::SymbolRate
+ * enum values, e.g. BM_EncodeBitStream/1/2 is QPSK125.
+ * 
+ * @date 2026-10-14
+ * @copyright Copyright (c) 2022
+ * @version 0.1
+ */
+
+#include "PSK.h"
+#include "PSKDemodulator.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+// Allocation counting for the 'bytes_allocated' counters
+static std::atomic<long long> bytes_allocated(0);
+
+void *operator new(std::size_t size) {
+    bytes_allocated.fetch_add(size, std::memory_order_relaxed);
+    void *pointer = std::malloc(size ? size : 1);
+    if (pointer == nullptr) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void operator delete(void *pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+/**
+ * @brief Access to the private stages of PSK.
+ */
+class PSKBench {
+    public:
+        static void addVaricode(PSK &psk, const std::string &message) {
+            psk.resetState();
+            for (const char &c : message) {
+                psk.addVaricode(c);
+            }
+            psk.pushBufferToBitStream();
+        }
+
+        static void addBits(PSK &psk, std::vector<unsigned char> &data) {
+            psk.resetState();
+            psk.addBits(data.data(), data.size() * 8);
+            psk.pushBufferToBitStream();
+        }
+
+        static void buildTextBitStream(PSK &psk, const std::string &message) {
+            psk.resetState();
+            psk.buildTextBitStream(message);
+        }
+
+        static size_t symbolCount(const PSK &psk) {
+            return psk.bit_stream_.size() * 32;
+        }
+
+        /**
+         * @brief Maps the whole bit stream to symbols in batches, returns a
+         * checksum of the phases so the mapping can not be optimized away.
+         */
+        static int mapSymbols(const PSK &psk) {
+            const size_t batch_size = 256;
+            PSK::Symbol symbols[batch_size];
+            PSK::EncoderState state;
+            BitStreamReader reader(psk.bit_stream_.data(), psk.bit_stream_.size());
+            int checksum = 0;
+            size_t count;
+            while ((count = psk.mapSymbols(state, reader, symbols, batch_size)) > 0) {
+                for (size_t i = 0; i < count; i++) {
+                    checksum += symbols[i].phase ^ symbols[i].transition;
+                }
+            }
+            return checksum;
+        }
+
+        /**
+         * @brief Modulates the current bit stream into 'out' without
+         * rebuilding it. The encoder state is restored afterwards, so every
+         * run produces the same samples.
+         */
+        static void encodeBitStream(PSK &psk, std::vector<int16_t> &out) {
+            out.clear();
+            psk.encoder_ = PSK::EncoderState();
+            psk.carrier_phase_ = 0;
+            psk.symbol_clock_ = 0;
+            psk.last_transition_ = 2;
+            psk.output_target_ = PSK::SAMPLE_VECTOR;
+            psk.sample_vector_ = &out;
+            psk.encodeBitStream();
+            psk.output_target_ = PSK::WAV_FILE;
+            psk.sample_vector_ = nullptr;
+        }
+};
+
+static std::string benchMessage(size_t length) {
+    const std::string text = "CQ CQ CQ de N0CALL The quick brown fox jumps over the lazy dog 0123456789. ";
+    std::string message;
+    while (message.size() < length) {
+        message += text;
+    }
+    message.resize(length);
+    return message;
+}
+
+static void BM_AddVaricode(benchmark::State &state) {
+    PSK psk("", PSK::BPSK, PSK::S125);
+    const std::string message = benchMessage(state.range(0));
+    for (auto _ : state) {
+        PSKBench::addVaricode(psk, message);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * message.size());
+}
+BENCHMARK(BM_AddVaricode)->Arg(1 << 16);
+
+static void BM_AddBits(benchmark::State &state) {
+    PSK psk("", PSK::BPSK, PSK::S125);
+    std::vector<unsigned char> data(state.range(0));
+    std::mt19937 random(1);
+    for (unsigned char &byte : data) {
+        byte = random();
+    }
+    for (auto _ : state) {
+        PSKBench::addBits(psk, data);
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_AddBits)->Arg(1 << 16);
+
+static void BM_EncodeBitStream(benchmark::State &state) {
+    PSK psk("", (PSK::Mode) state.range(0), (PSK::SymbolRate) state.range(1));
+    PSKBench::buildTextBitStream(psk, benchMessage(512));
+    std::vector<int16_t> out;
+    PSKBench::encodeBitStream(psk, out); // Warm the template cache
+    for (auto _ : state) {
+        PSKBench::encodeBitStream(psk, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * PSKBench::symbolCount(psk));
+    state.counters["samples/s"] = benchmark::Counter(
+        (double) state.iterations() * out.size(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_EncodeBitStream)->ArgsProduct({{PSK::BPSK, PSK::QPSK},
+                                            {PSK::S31, PSK::S63, PSK::S125,
+                                             PSK::S250, PSK::S500, PSK::S1000}});
+
+static void BM_MapSymbols(benchmark::State &state) {
+    PSK psk("", (PSK::Mode) state.range(0), PSK::S125);
+    PSKBench::buildTextBitStream(psk, benchMessage(4096));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(PSKBench::mapSymbols(psk));
+    }
+    state.SetItemsProcessed(state.iterations() * PSKBench::symbolCount(psk));
+}
+BENCHMARK(BM_MapSymbols)->Arg(PSK::BPSK)->Arg(PSK::QPSK);
+
+/**
+ * @brief Fixed point rendering of every symbol without the template cache,
+ * the configuration for targets without the memory for templates.
+ */
+static void BM_EncodeBitStreamFixed(benchmark::State &state) {
+    PSK psk("", (PSK::Mode) state.range(0), (PSK::SymbolRate) state.range(1));
+    psk.setFixedPoint(true);
+    psk.setSymbolTemplates(false);
+    PSKBench::buildTextBitStream(psk, benchMessage(512));
+    std::vector<int16_t> out;
+    for (auto _ : state) {
+        PSKBench::encodeBitStream(psk, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * PSKBench::symbolCount(psk));
+    state.counters["samples/s"] = benchmark::Counter(
+        (double) state.iterations() * out.size(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_EncodeBitStreamFixed)->ArgsProduct({{PSK::BPSK, PSK::QPSK},
+                                                 {PSK::S125, PSK::S500}});
+
+static void BM_EncodeTextData(benchmark::State &state) {
+    PSK psk("", (PSK::Mode) state.range(0), (PSK::SymbolRate) state.range(1));
+    const std::string message = benchMessage(512);
+    std::vector<int16_t> out;
+    long long samples = 0;
+    long long allocated = 0;
+    for (auto _ : state) {
+        out.clear();
+        long long before = bytes_allocated.load(std::memory_order_relaxed);
+        psk.encodeTextData(message, out);
+        allocated += bytes_allocated.load(std::memory_order_relaxed) - before;
+        samples += out.size();
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.counters["samples/s"] = benchmark::Counter(samples, benchmark::Counter::kIsRate);
+    state.counters["bytes_allocated"] = benchmark::Counter(
+        allocated, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_EncodeTextData)->ArgsProduct({{PSK::BPSK, PSK::QPSK},
+                                           {PSK::S31, PSK::S63, PSK::S125,
+                                            PSK::S250, PSK::S500, PSK::S1000}});
+
+/**
+ * @brief A QPSK125 beacon whose trailing timestamp changes on every message,
+ * rendered in full or with the incremental cache, with and without the
+ * template cache. Arguments are {incremental, symbol templates}.
+ */
+static void BM_EncodeBeacon(benchmark::State &state) {
+    PSK psk("", PSK::QPSK, PSK::S125);
+    psk.setIncremental(state.range(0));
+    psk.setSymbolTemplates(state.range(1));
+    std::vector<int16_t> out;
+    long long samples = 0;
+    int second = 0;
+    for (auto _ : state) {
+        char message[96];
+        std::snprintf(message, sizeof(message),
+                      "N0CALL 4807.038N 01131.000E 1234m -12C 12:%02d:%02d\n",
+                      second / 60 % 60, second % 60);
+        second++;
+        out.clear();
+        psk.encodeTextData(message, out);
+        samples += out.size();
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.counters["samples/s"] = benchmark::Counter(samples, benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_EncodeBeacon)->ArgsProduct({{0, 1}, {1, 0}});
+
+/**
+ * @brief Decodes a QPSK125 or BPSK125 message rendered by one of the
+ * renderers and counts the bits that differ from its bit stream. Arguments
+ * are {mode, renderer}: 0 = scalar reference, 1 = vectorized, 2 = fixed point,
+ * 3 = template cache.
+ */
+static void BM_Loopback(benchmark::State &state) {
+    const PSK::Mode mode = (PSK::Mode) state.range(0);
+    const int renderer = state.range(1);
+    PSK psk("", mode, PSK::S125);
+    psk.setSymbolTemplates(renderer == 3);
+    psk.setVectorized(renderer == 1);
+    psk.setFixedPoint(renderer == 2);
+    const std::string message = benchMessage(512);
+    std::vector<int16_t> samples;
+    psk.encodeTextData(message, samples);
+
+    PSKDemodulator demodulator(mode, PSK::S125);
+    long long errors = 0;
+    for (auto _ : state) {
+        errors = demodulator.bitErrors(message, samples.data(), samples.size());
+        benchmark::DoNotOptimize(errors);
+    }
+    state.counters["samples/s"] = benchmark::Counter(
+        (double) state.iterations() * samples.size(), benchmark::Counter::kIsRate);
+    state.counters["bit_errors"] = errors;
+}
+BENCHMARK(BM_Loopback)->ArgsProduct({{PSK::BPSK, PSK::QPSK}, {0, 1, 2, 3}});
+
+BENCHMARK_MAIN();
@@ -0,0 +1,304 @@
+/**
+ * @file PSKDemodulator.cpp
+ * @brief Implementation of the loopback BPSK and QPSK demodulator
+ * @details
+ * PSKDemodulator decodes audio rendered by PSK back to bits and text, so
+ * that an encode can be checked without a round trip through fldigi. It is a
+ * loopback decoder, not a receiver: the symbol timing and carrier are taken
+ * from the modulator settings instead of being recovered from the audio.
+ *
+ * Each symbol is reduced to one point, the least squares fit of the carrier
+ * (cos and -sin of the reference) over the middle half of the symbol, where
+ * the pulse shape is close to its peak and the neighbouring symbols barely
+ * overlap. BPSK bits are the sign of the phase change between two points.
+ * QPSK phase changes are decoded with a 16 state soft decision Viterbi
+ * decoder over conv_code, the same code PSK::mapSymbol() applies.
+ *
+ * @date 2026-10-14
+ * @copyright Copyright (c) 2022
+ * @version 0.1
+ */
+
+#include "PSKDemodulator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/**
+ * @brief Reverse of ascii_to_varicode, indexed by the code word (10 bits at
+ * most). 0xFF marks code words that are not a character.
+ */
+struct VaricodeDecodeTable {
+    uint8_t characters[1 << 10];
+};
+
+constexpr VaricodeDecodeTable makeVaricodeDecodeTable() {
+    VaricodeDecodeTable table = {};
+    for (int i = 0; i < (1 << 10); i++) {
+        table.characters[i] = 0xFF;
+    }
+    for (int c = 0; c < 128; c++) {
+        table.characters[ascii_to_varicode[c]] = (uint8_t) c;
+    }
+    return table;
+}
+
+constexpr VaricodeDecodeTable varicode_characters = makeVaricodeDecodeTable();
+
+/**
+ * @brief Construct a demodulator for audio rendered with these settings.
+ * @param mode BPSK or QPSK
+ * @param sym_rate Symbol rate
+ * @param config Sample rate, carrier and preamble/postamble length
+ * @param call_sign CW ID the audio starts and ends with, empty if none
+ */
+PSKDemodulator::PSKDemodulator(PSK::Mode mode, PSK::SymbolRate sym_rate,
+                               const PSK::Config &config,
+                               const std::string &call_sign)
+    : psk_("", mode, sym_rate, config) {
+    psk_.setCallSign(call_sign);
+    if (psk_.morse_callsign_) {
+        call_sign_samples_ = psk_.callSignSamples().size(); // Rejects an invalid callsign
+    }
+    carrier_cos_.resize(psk_.carrier_period_);
+    carrier_sin_.resize(psk_.carrier_period_);
+    for (int i = 0; i < psk_.carrier_period_; i++) {
+        carrier_cos_[i] = std::cos(psk_.angle_delta_ * i);
+        carrier_sin_[i] = -std::sin(psk_.angle_delta_ * i);
+    }
+}
+
+/**
+ * @brief Decodes 16 bit mono audio (with its CW ID, if any) back to text.
+ * @param samples
+ * @return std::string
+ */
+std::string PSKDemodulator::decodeText(const std::vector<int16_t> &samples) {
+    return decodeText(samples.data(), samples.size());
+}
+
+std::string PSKDemodulator::decodeText(const int16_t *samples, size_t count) {
+    return varicodeToText(decodeBits(samples, count));
+}
+
+/**
+ * @brief Decodes audio back to the bit stream, one bit (0 or 1) per symbol,
+ * preamble and postamble included.
+ * @param samples 16 bit mono audio, as encodeTextData() or encodeRawData()
+ * render it
+ * @param count Number of samples
+ * @return std::vector<uint8_t>
+ */
+std::vector<uint8_t> PSKDemodulator::decodeBits(const int16_t *samples, size_t count) {
+    if (count < 2 * call_sign_samples_) {
+        throw std::invalid_argument("Audio is shorter than the CW ID");
+    }
+    demodulateSymbols(samples + call_sign_samples_, count - 2 * call_sign_samples_);
+    std::vector<uint8_t> bits;
+    bits.reserve(points_.size());
+    if (psk_.mode_ == PSK::BPSK) {
+        decodeDifferential(bits);
+    } else {
+        decodeViterbi(bits);
+    }
+    return bits;
+}
+
+/**
+ * @brief The bit stream PSK sends for 'message', one bit per symbol, to
+ * compare decodeBits() with.
+ * @param message
+ * @return std::vector<uint8_t>
+ */
+std::vector<uint8_t> PSKDemodulator::textBits(const std::string &message) {
+    psk_.resetState();
+    psk_.buildTextBitStream(message);
+    std::vector<uint8_t> bits;
+    bits.reserve(psk_.bit_stream_.size() * 32);
+    for (const uint32_t &word : psk_.bit_stream_) {
+        for (int bit = 31; bit >= 0; bit--) {
+            bits.push_back((word >> bit) & 1);
+        }
+    }
+    return bits;
+}
+
+/**
+ * @brief Number of bits of the decoded audio that differ from the bit
+ * stream of 'message', missing or extra bits count as errors.
+ * @param message
+ * @param samples
+ * @param count
+ * @return long long
+ */
+long long PSKDemodulator::bitErrors(const std::string &message,
+                                    const int16_t *samples, size_t count) {
+    std::vector<uint8_t> sent = textBits(message);
+    std::vector<uint8_t> received = decodeBits(samples, count);
+    size_t common = std::min(sent.size(), received.size());
+    long long errors = std::max(sent.size(), received.size()) - common;
+    for (size_t i = 0; i < common; i++) {
+        errors += sent[i] != received[i];
+    }
+    return errors;
+}
+
+/**
+ * @brief Converts a bit stream to text: every code word between two 0 0
+ * separators is looked up in the varicode table. Idle (0's), the postamble
+ * (1's) and code words that are not a character produce no text.
+ * @param bits
+ * @return std::string
+ */
+std::string PSKDemodulator::varicodeToText(const std::vector<uint8_t> &bits) {
+    std::string text;
+    uint32_t code = 0;
+    int length = 0; // Bits in code, saturates once it can not be a character
+    for (const uint8_t &bit : bits) {
+        if (bit == 0 && (code & 1) == 0) { // Separator
+            code >>= 1;
+            if (code != 0 && length <= 11 && varicode_characters.characters[code] != 0xFF) {
+                text += (char) varicode_characters.characters[code];
+            }
+            code = 0;
+            length = 0;
+            continue;
+        }
+        code = (code << 1) | bit;
+        length = std::min(length + 1, 12);
+        code &= (1u << 12) - 1;
+    }
+    return text;
+}
+
+/**
+ * @brief Reduces every symbol of the PSK body to a point in points_.
+ * @details The symbols are clocked exactly like PSK::nextSymbolLength() and
+ * the fit over the middle half of each symbol solves the 2x2 normal
+ * equations of samples = i * cos + q * -sin, so it is exact for any window
+ * length and carrier frequency.
+ */
+void PSKDemodulator::demodulateSymbols(const int16_t *samples, size_t count) {
+    points_.clear();
+    points_.reserve(count / psk_.samples_per_symbol_);
+    int clock = 0;
+    int carrier_phase = 0;
+    size_t position = 0;
+    while (true) {
+        int length = psk_.nextSymbolLength(clock);
+        if (position + length > count) {
+            break;
+        }
+        const int first = length / 4;
+        const int last = length - length / 4;
+        int phase = (carrier_phase + first) % psk_.carrier_period_;
+        float cc = 0, ss = 0, cs = 0, xc = 0, xs = 0;
+        for (int i = first; i < last; i++) {
+            const float c = carrier_cos_[phase];
+            const float s = carrier_sin_[phase];
+            const float x = samples[position + i];
+            cc += c * c;
+            ss += s * s;
+            cs += c * s;
+            xc += x * c;
+            xs += x * s;
+            if (++phase == psk_.carrier_period_) {
+                phase = 0;
+            }
+        }
+        const float determinant = cc * ss - cs * cs;
+        Point point;
+        point.i = (ss * xc - cs * xs) / determinant;
+        point.q = (cc * xs - cs * xc) / determinant;
+        points_.push_back(point);
+
+        position += length;
+        carrier_phase = (carrier_phase + length) % psk_.carrier_period_;
+    }
+}
+
+/**
+ * @brief BPSK: a 1 keeps the phase, a 0 reverses it (see
+ * PSK::mapSymbol()). The first symbol is sent at phase 0 for a 0, so the
+ * phase before it counts as 180 degrees.
+ */
+void PSKDemodulator::decodeDifferential(std::vector<uint8_t> &bits) const {
+    Point previous = {-1, 0};
+    for (const Point &point : points_) {
+        float product = point.i * previous.i + point.q * previous.q;
+        bits.push_back(product >= 0 ? 1 : 0);
+        previous = point;
+    }
+}
+
+/**
+ * @brief QPSK: every bit is shifted into a 5 bit register and the symbol
+ * phase advances by conv_code[register] quarter turns. The decoder state is
+ * the last 4 bits, the branch metric is the correlation of the received
+ * phase change with the one the branch would send, and the path with the
+ * best metric at the end is traced back.
+ */
+void PSKDemodulator::decodeViterbi(std::vector<uint8_t> &bits) {
+    const int states = 16;
+    const float rotation_i[4] = {1, 0, -1, 0};
+    const float rotation_q[4] = {0, 1, 0, -1};
+    const float unreachable = -std::numeric_limits<float>::infinity();
+    float metric[states];
+    float next_metric[states];
+    for (int state = 0; state < states; state++) {
+        metric[state] = state == 0 ? 0 : unreachable; // Encoder starts from 0's
+    }
+
+    survivors_.assign(points_.size(), 0);
+    Point previous = {1, 0}; // Phase 0 before the first symbol
+    for (size_t k = 0; k < points_.size(); k++) {
+        const Point &point = points_[k];
+        // Phase change from the previous symbol, normalized so that every
+        // symbol weighs the same
+        float change_i = point.i * previous.i + point.q * previous.q;
+        float change_q = point.q * previous.i - point.i * previous.q;
+        float magnitude = std::sqrt(change_i * change_i + change_q * change_q);
+        if (magnitude > 0) {
+            change_i /= magnitude;
+            change_q /= magnitude;
+        }
+        float branch[4]; // Correlation with a change of 0 - 3 quarter turns
+        for (int shift = 0; shift < 4; shift++) {
+            branch[shift] = change_i * rotation_i[shift] + change_q * rotation_q[shift];
+        }
+
+        uint16_t decisions = 0;
+        for (int next = 0; next < states; next++) {
+            // The two predecessors differ in the oldest bit, the register
+            // is the predecessor followed by the new bit (next & 1)
+            int from_0 = next >> 1;
+            int from_1 = from_0 | 8;
+            float metric_0 = metric[from_0] + branch[conv_code[from_0 << 1 | (next & 1)]];
+            float metric_1 = metric[from_1] + branch[conv_code[from_1 << 1 | (next & 1)]];
+            if (metric_1 > metric_0) {
+                next_metric[next] = metric_1;
+                decisions |= 1 << next;
+            } else {
+                next_metric[next] = metric_0;
+            }
+        }
+        survivors_[k] = decisions;
+        for (int state = 0; state < states; state++) {
+            metric[state] = next_metric[state];
+        }
+        previous = point;
+    }
+
+    int state = 0;
+    for (int i = 1; i < states; i++) {
+        if (metric[i] > metric[state]) {
+            state = i;
+        }
+    }
+    bits.resize(points_.size());
+    for (size_t k = points_.size(); k-- > 0;) {
+        bits[k] = state & 1;
+        state = (state >> 1) | ((survivors_[k] >> state) & 1) << 3;
+    }
+}
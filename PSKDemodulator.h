@@ -0,0 +1,65 @@
+/**
+ * @file PSKDemodulator.h
+ * @brief Header file that defines PSKDemodulator, a coherent BPSK/QPSK
+ * demodulator and Viterbi decoder for checking rendered audio in memory
+ * (psk --verify).
+ * @date 2026-10-14
+ * @copyright Copyright (c) 2022
+ * @version 0.1
+ */
+
+#ifndef PSK_DEMODULATOR_H_
+#define PSK_DEMODULATOR_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "PSK.h"
+
+class PSKDemodulator {
+    public:
+        PSKDemodulator(PSK::Mode mode, PSK::SymbolRate sym_rate,
+                       const PSK::Config &config = PSK::Config(),
+                       const std::string &call_sign = "");
+
+        std::string decodeText(const std::vector<int16_t> &samples);
+        std::string decodeText(const int16_t *samples, size_t count);
+        std::vector<uint8_t> decodeBits(const int16_t *samples, size_t count);
+        std::vector<uint8_t> textBits(const std::string &message);
+        long long bitErrors(const std::string &message, const int16_t *samples,
+                            size_t count);
+        static std::string varicodeToText(const std::vector<uint8_t> &bits);
+
+    private:
+        /**
+         * @brief Received symbol, the carrier phase relative to the
+         * reference (cos phase, sin phase) scaled by the envelope.
+         */
+        struct Point {
+            float i;
+            float q;
+        };
+
+        void demodulateSymbols(const int16_t *samples, size_t count);
+        void decodeDifferential(std::vector<uint8_t> &bits) const;
+        void decodeViterbi(std::vector<uint8_t> &bits);
+
+        /**
+         * @details Timing, carrier and CW ID length of the modulator that
+         * rendered the audio. The audio is not synchronized to: symbol k of
+         * the body starts at the sample the PSK symbol clock puts it at and
+         * the carrier phase is the sample index into one carrier period, so
+         * only audio rendered with the same settings can be decoded.
+         */
+        PSK psk_;
+        size_t call_sign_samples_ = 0; // CW ID before and after the body
+        std::vector<float> carrier_cos_; // One carrier period
+        std::vector<float> carrier_sin_;
+
+        std::vector<Point> points_;
+        std::vector<uint16_t> survivors_; // Viterbi decisions, one bit per state
+};
+
+#endif // PSK_DEMODULATOR_H_
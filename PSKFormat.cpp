@@ -0,0 +1,137 @@
+/**
+ * @file PSKFormat.cpp
+ * @brief Implementation of the sample format conversion kernels, see
+ * PSKFormat.h.
+ * @date 2026-10-14
+ * @copyright Copyright (c) 2022
+ * @version 0.1
+ */
+
+#include "PSKFormat.h"
+
+#include <algorithm>
+#include <cstring>
+
+/**
+ * @details Branch free so that the compiler vectorizes the loop.
+ * (sample + 32768 + 128) / 256 rounds to nearest, samples above 32639 would
+ * round to 256 and are clamped.
+ */
+void convertPcm8(uint8_t *out, const int16_t *in, int count) {
+    for (int i = 0; i < count; i++) {
+        int value = (in[i] + 32768 + 128) >> 8;
+        out[i] = (uint8_t) std::min(value, 255);
+    }
+}
+
+void convertFloat32(float *out, const int16_t *in, int count) {
+    const float scale = 1.0f / 32768.0f;
+    for (int i = 0; i < count; i++) {
+        out[i] = in[i] * scale;
+    }
+}
+
+/**
+ * @brief IMA ADPCM quantizer step sizes.
+ */
+static const int16_t ima_step_table[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41,
+    45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209,
+    230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876,
+    963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749,
+    3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630,
+    9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385,
+    24623, 27086, 29794, 32767
+};
+
+/**
+ * @brief Step index change for each code magnitude.
+ */
+static const int8_t ima_index_table[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+
+void ImaAdpcmEncoder::reset() {
+    predictor_ = 0;
+    step_index_ = 0;
+    std::memset(block_, 0, sizeof(block_));
+    block_fill_ = 0;
+    samples_ = 0;
+}
+
+/**
+ * @brief Encodes 'count' samples, appending every block that is completed to
+ * 'out'.
+ * @param in
+ * @param count
+ * @param out
+ */
+void ImaAdpcmEncoder::encode(const int16_t *in, int count, std::vector<uint8_t> &out) {
+    for (int i = 0; i < count; i++) {
+        int sample = in[i];
+        if (block_fill_ == 0) { // The header carries the first sample exactly
+            predictor_ = sample;
+            block_[0] = (uint8_t) sample;
+            block_[1] = (uint8_t) (sample >> 8);
+            block_[2] = (uint8_t) step_index_;
+            block_[3] = 0;
+        } else {
+            uint8_t code = encodeSample(sample);
+            int nibble = block_fill_ - 1;
+            uint8_t &byte = block_[4 + nibble / 2];
+            byte = nibble & 1 ? (uint8_t) (byte | (code << 4)) : code;
+        }
+        if (++block_fill_ == samples_per_block) {
+            out.insert(out.end(), block_, block_ + block_align);
+            block_fill_ = 0;
+        }
+    }
+    samples_ += count;
+}
+
+/**
+ * @brief Appends the last, partly filled block (padded with silence codes).
+ * The wav fact chunk holds the real number of samples.
+ * @param out
+ */
+void ImaAdpcmEncoder::finish(std::vector<uint8_t> &out) {
+    if (block_fill_ > 0) {
+        int used = 4 + block_fill_ / 2; // Bytes holding a code, the rest is padding
+        std::memset(block_ + used, 0, block_align - used);
+        out.insert(out.end(), block_, block_ + block_align);
+        block_fill_ = 0;
+    }
+}
+
+/**
+ * @brief Quantizes the difference to the predicted sample into a 4 bit code
+ * and updates the predictor and step index the way the decoder will.
+ */
+uint8_t ImaAdpcmEncoder::encodeSample(int sample) {
+    int step = ima_step_table[step_index_];
+    int diff = sample - predictor_;
+    uint8_t code = 0;
+    if (diff < 0) {
+        code = 8;
+        diff = -diff;
+    }
+    int delta = step >> 3;
+    if (diff >= step) {
+        code |= 4;
+        diff -= step;
+        delta += step;
+    }
+    step >>= 1;
+    if (diff >= step) {
+        code |= 2;
+        diff -= step;
+        delta += step;
+    }
+    step >>= 1;
+    if (diff >= step) {
+        code |= 1;
+        delta += step;
+    }
+    predictor_ += code & 8 ? -delta : delta;
+    predictor_ = std::max(-32768, std::min(32767, predictor_));
+    step_index_ = std::max(0, std::min(88, step_index_ + ima_index_table[code & 7]));
+    return code;
+}
@@ -0,0 +1,69 @@
+/**
+ * @file PSKFormat.h
+ * @brief Sample format conversion kernels for the wav output stage: 8 bit
+ * unsigned PCM, 32 bit float and IMA ADPCM.
+ * @details The modulator always renders 16 bit samples. PSK::flushSamples()
+ * converts every output chunk with these kernels while it is still in cache,
+ * just before it is written.
+ * @date 2026-10-14
+ * @copyright Copyright (c) 2022
+ * @version 0.1
+ */
+
+#ifndef PSK_FORMAT_H_
+#define PSK_FORMAT_H_
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Converts 16 bit samples to 8 bit unsigned PCM (128 = silence),
+ * rounded to nearest.
+ * @param out Buffer of at least 'count' bytes
+ * @param in
+ * @param count Number of samples
+ */
+void convertPcm8(uint8_t *out, const int16_t *in, int count);
+
+/**
+ * @brief Converts 16 bit samples to 32 bit float (1.0 = full scale). The
+ * conversion is exact.
+ * @param out Buffer of at least 'count' floats
+ * @param in
+ * @param count Number of samples
+ */
+void convertFloat32(float *out, const int16_t *in, int count);
+
+/**
+ * @brief Streaming mono IMA ADPCM encoder (wav format 0x11), 4 bits per sample.
+ * @details Samples are encoded into blocks of block_align bytes: a 4 byte
+ * header holding the first sample and the step index, followed by
+ * samples_per_block - 1 samples two per byte, low nibble first. Complete
+ * blocks are appended to the output as soon as they are full, finish() pads
+ * and appends the last one.
+ */
+class ImaAdpcmEncoder {
+    public:
+        static constexpr int block_align = 512; // bytes
+        static constexpr int samples_per_block = (block_align - 4) * 2 + 1;
+
+        ImaAdpcmEncoder() { reset(); }
+
+        void reset();
+        void encode(const int16_t *in, int count, std::vector<uint8_t> &out);
+        void finish(std::vector<uint8_t> &out);
+
+        /** @brief Number of samples encoded since reset() */
+        long long samples() const { return samples_; }
+
+    private:
+        uint8_t encodeSample(int sample);
+
+        int predictor_;
+        int step_index_;
+        uint8_t block_[block_align];
+        int block_fill_; // Samples in block_
+        long long samples_;
+};
+
+#endif // PSK_FORMAT_H_
@@ -0,0 +1,380 @@
+/**
+ * @file PSKModulator.h
+ * @brief Serial modulator specialized at compile time for a mode and a
+ * number of samples per symbol.
+ * @details
+ * PSK::setup() selects PSKModulator<mode, samples per symbol>::encode() for
+ * the serial encoding loop (see selectModulator()). With the mode known at
+ * compile time the BPSK/QPSK mapping has no mode branch. With the symbol
+ * lengths (samples per symbol or one more, see PSK::symbol_clock_) known at
+ * compile time every symbol is copied to the output with a fixed size
+ * memcpy, and the fixed point renderer, which is used without the template
+ * cache, has fixed trip counts with the filter tests hoisted out of the
+ * loops and its Q15 pulse tables built with constexpr. The template cache
+ * and the float and SIMD renderers (PSK::symbolSamples()) still take the
+ * symbol length and the pulse shape at run time. Symbol lengths without a
+ * specialization use PSKModulator<mode, 0>, which reads them at run time.
+ * The output is identical to the runtime renderers in PSK.cpp.
+ *
+ * Only PSK.cpp includes this header.
+ *
+ * @date 2026-10-14
+ * @copyright Copyright (c) 2022
+ * @version 0.1
+ */
+
+#ifndef PSK_MODULATOR_H_
+#define PSK_MODULATOR_H_
+
+#include "PSK.h"
+
+#include <cstring>
+
+/**
+ * @brief Envelope pulse shape cos(|t| / sps * roll_off)^2 in Q15, evaluated
+ * with the Q15 sine table. 1982339299 = roll_off (2.9) / 2pi * 2^32.
+ * @param time Sample relative to the centre of the symbol
+ * @param samples_per_symbol
+ */
+constexpr int32_t filterShapeQ15(int time, int samples_per_symbol) {
+    const uint64_t roll_off_phase = 1982339299;
+    uint64_t distance = time < 0 ? -time : time;
+    uint32_t angle = distance * roll_off_phase / samples_per_symbol;
+    int32_t cosine = sineQ15(angle + (1u << 30));
+    return (cosine * cosine + (1 << 14)) >> 15;
+}
+
+/**
+ * @brief Raised cosine pulse cos^2(pi * t / 2T) in Q15, evaluated with the
+ * Q15 sine table. See filterShapeQ15() for parameters.
+ */
+constexpr int32_t pulseQ15(int time, int samples_per_symbol) {
+    uint64_t distance = time < 0 ? -time : time;
+    uint32_t angle = (distance << 30) / samples_per_symbol; // |t| / 4T turns
+    int32_t cosine = sineQ15(angle + (1u << 30));
+    return (cosine * cosine + (1 << 14)) >> 15;
+}
+
+/**
+ * @brief The Q15 pulse tables of the fixed point renderers for one symbol
+ * length, same as PSK::filter_shape_q15_ and PSK::pulse_q15_.
+ */
+template <int SamplesPerSymbol>
+struct PulseTablesQ15 {
+    int32_t filter_shape[SamplesPerSymbol];
+    int32_t pulse[SamplesPerSymbol];
+};
+
+template <int SamplesPerSymbol>
+constexpr PulseTablesQ15<SamplesPerSymbol> makePulseTablesQ15() {
+    PulseTablesQ15<SamplesPerSymbol> tables = {};
+    int time = 0 - (SamplesPerSymbol / 2);
+    for (int i = 0; i < SamplesPerSymbol; i++, time++) {
+        tables.filter_shape[i] = filterShapeQ15(time, SamplesPerSymbol);
+        tables.pulse[i] = pulseQ15(time, SamplesPerSymbol);
+    }
+    return tables;
+}
+
+template <int SamplesPerSymbol>
+constexpr PulseTablesQ15<SamplesPerSymbol> pulse_tables_q15 =
+    makePulseTablesQ15<SamplesPerSymbol>();
+
+/**
+ * @brief The QPSK convolutional code applied to 8 bits at once. Symbol i
+ * of the byte is in bits 15 - 2i and 14 - 2i of each field.
+ */
+struct ConvCodeByte {
+    uint16_t phases; // Phase relative to the phase before the byte
+    uint16_t transitions; // Shift into the next symbol, 0 for the last one
+};
+
+/**
+ * @brief ConvCodeByte for every encoder state (the low 4 bits of
+ * PSK::EncoderState::conv_code_buffer, the 5th is shifted out by the first
+ * bit) and byte, 16 KiB.
+ */
+struct ConvCodeByteTable {
+    ConvCodeByte entries[16][256];
+};
+
+constexpr ConvCodeByteTable makeConvCodeByteTable() {
+    ConvCodeByteTable table = {};
+    for (int state = 0; state < 16; state++) {
+        for (int byte = 0; byte < 256; byte++) {
+            ConvCodeByte entry = {0, 0};
+            unsigned buffer = state;
+            int phase = 0;
+            for (int i = 0; i < 8; i++) {
+                buffer = ((buffer << 1) | ((byte >> (7 - i)) & 1)) & 0x1f;
+                phase = (phase + conv_code[buffer]) & 3;
+                entry.phases |= phase << (14 - 2 * i);
+                if (i < 7) {
+                    unsigned next = ((buffer << 1) | ((byte >> (6 - i)) & 1)) & 0x1f;
+                    entry.transitions |= conv_code[next] << (14 - 2 * i);
+                }
+            }
+            table.entries[state][byte] = entry;
+        }
+    }
+    return table;
+}
+
+constexpr ConvCodeByteTable conv_code_bytes = makeConvCodeByteTable();
+
+/**
+ * @brief Serial modulator for one mode and symbol length.
+ * @tparam M PSK::BPSK or PSK::QPSK
+ * @tparam SamplesPerSymbol Symbol length in samples, 0 = PSK::samples_per_symbol_
+ */
+template <PSK::Mode M, int SamplesPerSymbol>
+class PSKModulator {
+    public:
+        /**
+         * @brief Maps and renders words [first_word, last_word) of the bit
+         * stream of 'psk' to its output, continuing from its encoder, carrier
+         * and filter state.
+         * @param checkpoints If not null, the state before every word is
+         * stored at checkpoints[word] and the state after the last word at
+         * checkpoints[last_word], see PSK::ModulatorState
+         */
+        static void encode(PSK &psk, size_t first_word, size_t last_word,
+                           PSK::ModulatorState *checkpoints) {
+            // Without the template cache the fixed point renderers are used
+            // directly, everything else goes through the runtime renderers
+            const bool render_fixed = !psk.symbol_templates_.enabled && psk.fixed_point_;
+            BitStreamReader reader(psk.bit_stream_.data() + first_word,
+                                   psk.bit_stream_.size() - first_word);
+            PSK::Symbol symbols[32];
+            for (size_t word = first_word; word < last_word; word++) {
+                if (checkpoints) {
+                    checkpoints[word] = psk.modulatorState();
+                }
+                mapWord(psk.encoder_, reader, symbols);
+                for (int bit = 0; bit < 32; bit++) {
+                    const int phase = symbols[bit].phase;
+                    const int transition = symbols[bit].transition;
+
+                    int length = psk.nextSymbolLength(psk.symbol_clock_);
+                    int16_t *out = psk.reserveSamples(length);
+                    const int16_t *samples = out;
+                    if (render_fixed) {
+                        renderFixed(psk, out, length, psk.carrier_phase_, phase,
+                                    psk.last_transition_, transition);
+                    } else {
+                        samples = psk.symbolSamples(psk.symbol_templates_, length,
+                                                    psk.carrier_phase_, phase,
+                                                    psk.last_transition_, transition, out);
+                    }
+                    if (samples != out) {
+                        copySymbol(out, samples, length);
+                    }
+                    psk.carrier_phase_ = (psk.carrier_phase_ + length) % psk.carrier_period_;
+                    psk.last_transition_ = transition;
+                    psk.commitSamples(length);
+                }
+            }
+            if (checkpoints) {
+                checkpoints[last_word] = psk.modulatorState();
+            }
+        }
+
+        /**
+         * @brief Maps the next word (32 bits) of the reader to 'symbols'. QPSK
+         * is mapped a byte at a time with mapByte().
+         */
+        static void mapWord(PSK::EncoderState &state, BitStreamReader &reader,
+                            PSK::Symbol *symbols) {
+            if constexpr (M == PSK::QPSK) {
+                for (int byte = 0; byte < 4; byte++) {
+                    mapByte(state, reader.byte(), reader.nextByteBit(), symbols + byte * 8);
+                    reader.advanceByte();
+                }
+            } else {
+                for (int bit = 0; bit < 32; bit++) {
+                    int phase;
+                    int transition;
+                    mapSymbol(state, reader.bit(), reader.nextBit(), phase, transition);
+                    symbols[bit].phase = phase;
+                    symbols[bit].transition = transition;
+                    reader.advance();
+                }
+            }
+        }
+
+        /**
+         * @brief Same as PSK::mapSymbol() in QPSK mode for the 8 bits of
+         * 'byte' (first bit in the MSB) with one lookup in conv_code_bytes.
+         * @param next_bit The bit after the byte [1, 0, -1] -1 = end of bit stream
+         * @param symbols Set to the 8 symbols of the byte
+         */
+        static void mapByte(PSK::EncoderState &state, unsigned byte, int next_bit,
+                            PSK::Symbol *symbols) {
+            const ConvCodeByte &entry = conv_code_bytes.entries[state.conv_code_buffer & 0x0f][byte];
+            for (int i = 0; i < 8; i++) {
+                symbols[i].phase = (state.symbol_phase + (entry.phases >> (14 - 2 * i))) & 3;
+                symbols[i].transition = (entry.transitions >> (14 - 2 * i)) & 3;
+            }
+            state.conv_code_buffer = byte & 0x1f;
+            state.symbol_phase = symbols[7].phase;
+            symbols[7].transition = next_bit == -1 ? 2 : conv_code[((byte << 1) | next_bit) & 0x1f];
+        }
+
+        /**
+         * @brief Same as PSK::mapSymbol() for mode M.
+         */
+        static void mapSymbol(PSK::EncoderState &state, int bit, int next_bit,
+                              int &phase, int &transition) {
+            if constexpr (M == PSK::BPSK) {
+                // If next bit is 1, the phase stays the same.
+                transition = next_bit == 1 ? 0 : 2;
+                phase = (state.last_phase ^ bit) ? 2 : 0;
+                if (!bit) { // Encode a 0 by switching phase
+                    state.last_phase = !state.last_phase;
+                }
+            } else {
+                state.conv_code_buffer = ((state.conv_code_buffer << 1) | bit) & 0x1f;
+                state.symbol_phase = (state.symbol_phase + conv_code[state.conv_code_buffer]) & 3;
+                unsigned char next_buffer = ((state.conv_code_buffer << 1) | (next_bit & 1)) & 0x1f;
+                transition = next_bit == -1 ? 2 : conv_code[next_buffer];
+                phase = state.symbol_phase;
+            }
+        }
+
+    private:
+        /**
+         * @brief Copies a symbol of samples per symbol or one more samples
+         * with a memcpy of a compile time size.
+         */
+        static void copySymbol(int16_t *out, const int16_t *samples, int length) {
+            if constexpr (SamplesPerSymbol > 0) {
+                if (length == SamplesPerSymbol) {
+                    std::memcpy(out, samples, SamplesPerSymbol * sizeof(int16_t));
+                } else {
+                    std::memcpy(out, samples, (SamplesPerSymbol + 1) * sizeof(int16_t));
+                }
+            } else {
+                std::memcpy(out, samples, length * sizeof(int16_t));
+            }
+        }
+
+        /**
+         * @brief Same as PSK::renderSymbol() with fixed point enabled, for a
+         * symbol of samples per symbol or one more samples.
+         */
+        static void renderFixed(const PSK &psk, int16_t *out, int length,
+                                int carrier_phase, int phase, int transition_in,
+                                int transition_out) {
+            if constexpr (SamplesPerSymbol > 0) {
+                if (length == SamplesPerSymbol) {
+                    renderFixedLength<SamplesPerSymbol>(psk, out, length, carrier_phase,
+                                                        phase, transition_in,
+                                                        transition_out);
+                } else {
+                    renderFixedLength<SamplesPerSymbol + 1>(psk, out, length,
+                                                            carrier_phase, phase,
+                                                            transition_in,
+                                                            transition_out);
+                }
+            } else {
+                renderFixedLength<0>(psk, out, length, carrier_phase, phase,
+                                     transition_in, transition_out);
+            }
+        }
+
+        /**
+         * @brief Renders a fixed point symbol 'Length' samples long, or
+         * 'length' samples long with the runtime tables if Length is 0. Each
+         * half of the symbol is rendered by its own loop, so the filter and
+         * neighbour are constant inside the loops.
+         */
+        template <int Length>
+        static void renderFixedLength(const PSK &psk, int16_t *out, int length,
+                                      int carrier_phase, int phase,
+                                      int transition_in, int transition_out) {
+            const int32_t unity = 1 << 15;
+            const int samples = Length > 0 ? Length : length;
+            const int half = samples / 2;
+            const int offset = psk.pulseTableOffset(samples);
+            const uint32_t step = psk.phase_step_;
+            // Phase word at the start of the symbol plus a quarter turn for cosine
+            uint32_t nco = (uint32_t) carrier_phase * step
+                           + ((uint32_t) (phase + 1) << 30);
+
+            if (psk.pulse_shape_ == PSK::RAISED_COSINE) {
+                const int32_t *shape = &psk.pulse_q15_[offset];
+                if constexpr (Length > 0) {
+                    shape = pulse_tables_q15<Length>.pulse;
+                }
+                renderShapedHalf(out, shape, 0, half, (4 - transition_in) & 3, nco, step);
+                renderShapedHalf(out, shape, half, samples, transition_out,
+                                 nco + half * step, step);
+                return;
+            }
+            // The envelope is filtered on the side of any phase change, the
+            // centre sample is always filtered (the filter is 1 there)
+            const int32_t *filter = &psk.filter_shape_q15_[offset];
+            if constexpr (Length > 0) {
+                filter = pulse_tables_q15<Length>.filter_shape;
+            }
+            const bool filter_start = transition_in != 0;
+            const bool filter_end = transition_out != 0;
+            for (int i = 0; i < half; i++, nco += step) {
+                int32_t shape = filter_start ? filter[i] : unity;
+                out[i] = (int16_t) ((shape * sineQ15(nco)) / (2 * unity));
+            }
+            out[half] = (int16_t) ((filter[half] * sineQ15(nco)) / (2 * unity));
+            nco += step;
+            for (int i = half + 1; i < samples; i++, nco += step) {
+                int32_t shape = filter_end ? filter[i] : unity;
+                out[i] = (int16_t) ((shape * sineQ15(nco)) / (2 * unity));
+            }
+        }
+
+        /**
+         * @brief Renders samples [first, last) of a raised cosine symbol that
+         * overlaps the neighbouring symbol rotated by 'neighbour' quarter
+         * turns, see PSK::renderShapedFixed().
+         */
+        static void renderShapedHalf(int16_t *out, const int32_t *shape, int first,
+                                     int last, int neighbour, uint32_t nco,
+                                     uint32_t step) {
+            const int32_t unity = 1 << 15;
+            const int rotation_i[4] = {1, 0, -1, 0};
+            const int rotation_q[4] = {0, 1, 0, -1};
+            const int32_t neighbour_i = rotation_i[neighbour];
+            const int32_t neighbour_q = rotation_q[neighbour];
+            for (int i = first; i < last; i++, nco += step) {
+                int32_t overlap = unity - shape[i];
+                int64_t in_phase = shape[i] + neighbour_i * overlap;
+                int64_t quadrature = neighbour_q * overlap;
+                int64_t carrier = in_phase * sineQ15(nco)
+                                  - quadrature * sineQ15(nco - (1u << 30));
+                out[i] = (int16_t) (carrier / (2 * unity));
+            }
+        }
+};
+
+/**
+ * @brief Selects PSKModulator<M, S>::encode for the S in Specialized equal to
+ * 'samples_per_symbol', or the runtime PSKModulator<M, 0>.
+ */
+template <PSK::Mode M, int... Specialized>
+auto selectSpecializedModulator(int samples_per_symbol) {
+    auto modulator = &PSKModulator<M, 0>::encode; // Same type as PSK::modulator_
+    ((samples_per_symbol == Specialized
+      ? (void) (modulator = &PSKModulator<M, Specialized>::encode) : (void) 0), ...);
+    return modulator;
+}
+
+/**
+ * @brief The modulator for mode M. Specialized symbol lengths: 125, 250, 500
+ * and 1000 Sym/s at 44.1, 48, 8 and 12 kHz.
+ */
+template <PSK::Mode M>
+auto selectModulator(int samples_per_symbol) {
+    return selectSpecializedModulator<M, 352, 176, 88, 44, 384, 192, 96, 48,
+                                      64, 32, 16, 8, 24, 12>(samples_per_symbol);
+}
+
+#endif // PSK_MODULATOR_H_
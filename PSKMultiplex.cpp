@@ -0,0 +1,156 @@
+/**
+ * @file PSKMultiplex.cpp
+ * @brief Implementation of the multi-channel (FDM) PSK renderer
+ * @details
+ * Every channel is modulated by its own PSKStream at its own carrier
+ * frequency. The output is the sum of the channels, scaled by
+ * level / (sum of all levels) so that the peak of the mix can never exceed
+ * full scale even when every carrier lines up. Channels that end early
+ * contribute silence for the rest of the output.
+ * 
+ * @date 2026-10-14
+ * @copyright Copyright (c) 2022
+ * @version 0.1
+ */
+
+#include "PSKMultiplex.h"
+
+#include <cmath>
+#include <stdexcept>
+
+/**
+ * @brief Construct an empty multiplexer.
+ * @param config Output settings shared by all channels. The carrier_freq
+ * field is replaced by each channel's carrier.
+ */
+PSKMultiplex::PSKMultiplex(const PSK::Config &config) : config_(config) {
+}
+
+/**
+ * @brief Adds a channel. The carrier and symbol rate are checked against
+ * the sample rate here, so a bad channel fails before any audio is written.
+ * @param channel 
+ */
+void PSKMultiplex::addChannel(const Channel &channel) {
+    if (channel.level <= 0) {
+        throw std::invalid_argument("Channel level must be positive");
+    }
+    PSK::Config config = config_;
+    config.carrier_freq = channel.carrier_freq;
+    PSK check("", channel.mode, channel.symbol_rate, config); // Throws if invalid
+    channels_.push_back(channel);
+}
+
+/**
+ * @brief Removes all channels.
+ */
+void PSKMultiplex::clearChannels() {
+    channels_.clear();
+}
+
+/**
+ * @brief Returns the number of channels.
+ */
+int PSKMultiplex::channelCount() const {
+    return channels_.size();
+}
+
+/**
+ * @brief Mixes all channels into a wav file in the sample format of the
+ * config.
+ * @param file_path 
+ * @return true - Success
+ * @return false - Failure (no channels or the file could not be opened)
+ */
+bool PSKMultiplex::encode(std::string file_path) {
+    if (channels_.empty()) {
+        return false;
+    }
+    // The wav header, sample format conversion, output buffering and size
+    // fields are PSK's, the mode, symbol rate and carrier of the writer are
+    // not used
+    const Channel &first = channels_.front();
+    PSK::Config config = config_;
+    config.carrier_freq = first.carrier_freq;
+    PSK writer(file_path, first.mode, first.symbol_rate, config);
+    if (!writer.openFile(file_path)) {
+        return false;
+    }
+    writer.resetState();
+    writer.writeHeader();
+    mix(nullptr, &writer);
+    writer.finalizeFile();
+    return true;
+}
+
+/**
+ * @brief Mixes all channels into a sample vector.
+ * @param out Receives the 16 bit mono samples, existing contents are replaced
+ * @return true - Success
+ * @return false - Failure (no channels)
+ */
+bool PSKMultiplex::encode(std::vector<int16_t> &out) {
+    out.clear();
+    if (channels_.empty()) {
+        return false;
+    }
+    return mix(&out, nullptr);
+}
+
+// Private Methods
+
+/**
+ * @brief Runs the channels side by side and sums them a block at a time.
+ * @param out Sample vector, or nullptr to write to 'writer'
+ * @param writer PSK with an open wav file, see encode(std::string)
+ */
+bool PSKMultiplex::mix(std::vector<int16_t> *out, PSK *writer) {
+    std::vector<std::unique_ptr<PSKStream>> streams;
+    std::vector<float> gains;
+    double total_level = 0;
+    for (const Channel &channel : channels_) {
+        total_level += channel.level;
+    }
+    for (const Channel &channel : channels_) {
+        PSK::Config config = config_;
+        config.carrier_freq = channel.carrier_freq;
+        streams.emplace_back(new PSKStream(channel.mode, channel.symbol_rate, config));
+        streams.back()->push(channel.message);
+        streams.back()->finish();
+        gains.push_back(channel.level / total_level);
+    }
+
+    std::vector<int16_t> channel_block(block_size_);
+    std::vector<float> accumulator(block_size_);
+    std::vector<int16_t> block(block_size_);
+    size_t active = streams.size();
+    while (active > 0) {
+        std::fill(accumulator.begin(), accumulator.end(), 0.0f);
+        size_t block_length = 0;
+        active = 0;
+        for (size_t c = 0; c < streams.size(); c++) {
+            if (streams[c]->done()) {
+                continue;
+            }
+            size_t n = streams[c]->pull(channel_block.data(), block_size_);
+            float gain = gains[c];
+            for (size_t i = 0; i < n; i++) {
+                accumulator[i] += channel_block[i] * gain;
+            }
+            block_length = std::max(block_length, n);
+            if (!streams[c]->done()) {
+                active++;
+            }
+        }
+        for (size_t i = 0; i < block_length; i++) {
+            float sample = std::round(accumulator[i]);
+            block[i] = (int16_t) std::max(-32767.0f, std::min(32767.0f, sample));
+        }
+        if (out != nullptr) {
+            out->insert(out->end(), block.begin(), block.begin() + block_length);
+        } else {
+            writer->writeSamples(block.data(), block_length);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,59 @@
+/**
+ * @file PSKMultiplex.h
+ * @brief Header file that defines the PSKMultiplex class, which renders
+ * several PSK signals on different carriers into one output.
+ * @date 2026-10-14
+ * @copyright Copyright (c) 2022
+ * @version 0.1
+ */
+
+#ifndef PSK_MULTIPLEX_H_
+#define PSK_MULTIPLEX_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "PSK.h"
+#include "PSKStream.h"
+
+class PSKMultiplex {
+    public:
+        /**
+         * @brief One signal in the passband. 'level' is relative to the
+         * other channels, the mix is always scaled to fit in 16 bits.
+         */
+        struct Channel {
+            std::string message;
+            PSK::Mode mode = PSK::BPSK;
+            PSK::SymbolRate symbol_rate = PSK::S125;
+            int carrier_freq = 1500; // Hz
+            double level = 1.0;
+        };
+
+        explicit PSKMultiplex(const PSK::Config &config = PSK::Config());
+
+        void addChannel(const Channel &channel);
+        void clearChannels();
+        int channelCount() const;
+
+        bool encode(std::string file_path);
+        bool encode(std::vector<int16_t> &out);
+
+    private:
+        bool mix(std::vector<int16_t> *out, PSK *writer);
+
+        /**
+         * @details Each channel is a PSKStream with its own carrier, so it
+         * keeps its own carrier phase (NCO), symbol templates and encoder
+         * state. The channels are pulled a block at a time and summed into
+         * one accumulator, so every output sample is produced in a single
+         * pass and no per channel audio is buffered.
+         */
+        PSK::Config config_;
+        std::vector<Channel> channels_;
+
+        static const int block_size_ = 4096; // Samples mixed per pass
+};
+
+#endif // PSK_MULTIPLEX_H_
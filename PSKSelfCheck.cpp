@@ -0,0 +1,449 @@
+/**
+ * @file PSKSelfCheck.cpp
+ * @brief Golden output regression check
+ * @details
+ * A fixed corpus is encoded for every mode, symbol rate and pulse shape.
+ * 
+ * The reference is the scalar renderer (no template cache, no SIMD, one
+ * thread). Its output, and the output of the fixed point renderer, are
+ * compared against golden FNV-1a hashes. The fixed point hash is exact on
+ * every platform. The float hash can change if libm rounds cos/pow
+ * differently.
+ * 
+ * The fast paths are then checked against the reference: the template
+ * cache and the parallel encoder must match exactly, the SIMD and fixed
+ * point renderers within a tolerance.
+ * 
+ * A second table locks the output paths the corpus above does not take:
+ * other sample rates (including ones with fractional symbol lengths), the
+ * CW ID, every sample format and every sink (callback, wav stream,
+ * memory mapped and stream written files, appended messages). Files and
+ * streams are hashed as the bytes written, header included. The sink cases
+ * use the default renderers (template cache on), so they also check that
+ * the sinks write what the vector path renders.
+ * 
+ * Reconfiguring is checked too: setup() with only a mode and symbol rate
+ * keeps the sample rate and carrier, and a setup() that throws leaves the
+ * previous configuration encoding exactly as before.
+ * 
+ * If a change is meant to alter the audio, regenerate the tables with
+ * psk --selfcheck --golden and paste them into golden_hashes and
+ * output_cases below.
+ * 
+ * @date 2026-10-14
+ * @copyright Copyright (c) 2022
+ * @version 0.1
+ */
+
+#include "PSKSelfCheck.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+/**
+ * @brief Golden hashes of the reference (float) and fixed point output,
+ * indexed by [pulse shape][mode][symbol rate].
+ */
+struct GoldenHash {
+    uint64_t reference;
+    uint64_t fixed_point;
+};
+
+const GoldenHash golden_hashes[2][2][6] = {
+    { // envelope
+        { // BPSK
+            {0x1eebbce860d3b7e4ULL, 0xd84d46460e9cb80fULL}, // 31
+            {0x6577c1cbe92f4ce4ULL, 0xede235c63fee39bfULL}, // 63
+            {0xe8dcf27ac8be1157ULL, 0x7e9b4412aacfa0e2ULL}, // 125
+            {0xb0ab5d21b255b0c6ULL, 0xe2edd59ab0345b1bULL}, // 250
+            {0x82196cf3cd7b9c32ULL, 0xbc1d9c7551efd56aULL}, // 500
+            {0xd11aef5d576a6de8ULL, 0xb763ef26806e4b4bULL}, // 1000
+        },
+        { // QPSK
+            {0x8324e907d18b1680ULL, 0xf2b789c950c7b6f7ULL}, // 31
+            {0x51a23c8560405845ULL, 0xa5fc7f3a43706e8dULL}, // 63
+            {0x70d36491dfd5f23cULL, 0xa7a421e1f95326c3ULL}, // 125
+            {0x751a85cc49a3e2a0ULL, 0x60dcccc01ee2776eULL}, // 250
+            {0x0fa4db3d1ddc3c70ULL, 0x65f7bda22355b03cULL}, // 500
+            {0x9500c4e841f80573ULL, 0x3f217434848e6f16ULL}, // 1000
+        },
+    },
+    { // rc
+        { // BPSK
+            {0x6ba5ac87e003d365ULL, 0x4cce5b7af7913625ULL}, // 31
+            {0x128e62d6ffafee75ULL, 0x28d3bf24d1cc57beULL}, // 63
+            {0xbe5e11764ee8f893ULL, 0x24b1d9b4ee2d62d4ULL}, // 125
+            {0x3ed3c7eb3503cad1ULL, 0x81c23f7ed87411a5ULL}, // 250
+            {0xe31f900c871cd6a9ULL, 0xe602973044bc5eb2ULL}, // 500
+            {0xa17871bb8ebbfe80ULL, 0x68ae1e3632fad3bdULL}, // 1000
+        },
+        { // QPSK
+            {0xf73609aea181dda0ULL, 0x6e6f3bff5ad8cc77ULL}, // 31
+            {0x2f1a97f060302796ULL, 0xb5b02d0b14d8b898ULL}, // 63
+            {0x41ecf137332766f5ULL, 0xecdc6389403a6bd4ULL}, // 125
+            {0x1eee740727204c40ULL, 0x55d5d941b1bb86f2ULL}, // 250
+            {0xfdd823307fab1d41ULL, 0x7fd5993bcad80015ULL}, // 500
+            {0xd6237bf3417e3a63ULL, 0xb873823d1e8f47e8ULL}, // 1000
+        },
+    },
+};
+
+/**
+ * @brief Sinks of the output path cases, see output_cases.
+ */
+enum Sink {
+    SAMPLE_VECTOR,
+    SAMPLE_CALLBACK,
+    OUTPUT_STREAM, // Wav stream to an std::ostream
+    MAPPED_FILE,
+    WAV_FILE, // Written with stream writes
+    APPENDED // beginTextData(), two messages, endTextData()
+};
+
+/**
+ * @brief One output path, encoded with the default renderers.
+ */
+struct OutputCase {
+    const char *name;
+    PSK::Mode mode;
+    PSK::SymbolRate rate;
+    int sample_rate;
+    int carrier_freq;
+    PSK::SampleFormat format;
+    const char *call_sign;
+    Sink sink;
+    uint64_t golden;
+};
+
+const OutputCase output_cases[] = {
+    {"8k-qpsk63", PSK::QPSK, PSK::S63, 8000, 1000, PSK::PCM16, "", SAMPLE_VECTOR,
+     0x6b5c7e05b2bec300ULL},
+    {"11k-bpsk31", PSK::BPSK, PSK::S31, 11025, 1500, PSK::PCM16, "", SAMPLE_VECTOR,
+     0x0d7d0c6b83b1efa4ULL},
+    {"48k-qpsk1000", PSK::QPSK, PSK::S1000, 48000, 1500, PSK::PCM16, "", SAMPLE_VECTOR,
+     0x7f09827bb9e23722ULL},
+    {"callsign", PSK::BPSK, PSK::S125, 44100, 1500, PSK::PCM16, "N0CALL", SAMPLE_VECTOR,
+     0xdc5e30fe768aa9dfULL},
+    {"callback", PSK::BPSK, PSK::S250, 44100, 1500, PSK::PCM16, "", SAMPLE_CALLBACK,
+     0xb0ab5d21b255b0c6ULL},
+    {"stream", PSK::QPSK, PSK::S250, 44100, 1500, PSK::PCM16, "", OUTPUT_STREAM,
+     0xacc627915083bffeULL},
+    {"mapped", PSK::BPSK, PSK::S125, 44100, 1500, PSK::PCM16, "", MAPPED_FILE,
+     0x34aec7965a1003f1ULL},
+    {"file", PSK::BPSK, PSK::S125, 44100, 1500, PSK::PCM16, "", WAV_FILE,
+     0x34aec7965a1003f1ULL},
+    {"pcm8", PSK::QPSK, PSK::S125, 44100, 1500, PSK::PCM8, "", MAPPED_FILE,
+     0x37193a51a49a3444ULL},
+    {"float", PSK::QPSK, PSK::S125, 44100, 1500, PSK::FLOAT32, "", MAPPED_FILE,
+     0xc3f47b3b09438415ULL},
+    {"adpcm", PSK::QPSK, PSK::S125, 44100, 1500, PSK::IMA_ADPCM, "", MAPPED_FILE,
+     0xa18e24c418685d1cULL},
+    {"adpcm-stream", PSK::QPSK, PSK::S125, 44100, 1500, PSK::IMA_ADPCM, "", OUTPUT_STREAM,
+     0x0b5e1f01ba93f42fULL},
+    {"append", PSK::QPSK, PSK::S500, 12000, 1000, PSK::PCM16, "N0CALL", APPENDED,
+     0x1f055e05820f677bULL},
+};
+
+const int output_case_count = sizeof(output_cases) / sizeof(output_cases[0]);
+const char *sink_names[] = {"SAMPLE_VECTOR", "SAMPLE_CALLBACK", "OUTPUT_STREAM",
+                            "MAPPED_FILE", "WAV_FILE", "APPENDED"};
+const char *format_names[] = {"PCM16", "PCM8", "FLOAT32", "IMA_ADPCM"};
+
+const PSK::SymbolRate symbol_rates[6] = {
+    PSK::S31, PSK::S63, PSK::S125, PSK::S250, PSK::S500, PSK::S1000
+};
+const char *symbol_rate_names[6] = {"31", "63", "125", "250", "500", "1000"};
+const char *mode_names[2] = {"BPSK", "QPSK"};
+const char *shape_names[2] = {"envelope", "rc"};
+
+} // namespace
+
+/**
+ * @brief Runs every check and prints one line per mode/rate/shape.
+ * @param out 
+ * @param tolerance 
+ * @return true - every check passed
+ */
+bool PSKSelfCheck::run(std::ostream &out, const Tolerance &tolerance) {
+    bool passed = true;
+    for (int shape = 0; shape < 2; shape++) {
+        for (int mode = 0; mode < 2; mode++) {
+            for (int rate = 0; rate < 6; rate++) {
+                PSK::Mode m = (PSK::Mode) mode;
+                PSK::PulseShape s = (PSK::PulseShape) shape;
+                PSK::SymbolRate r = symbol_rates[rate];
+                const GoldenHash &golden = golden_hashes[shape][mode][rate];
+
+                std::vector<int16_t> reference = encode(m, r, s, false, false, false, 1);
+                std::vector<int16_t> fixed = encode(m, r, s, true, false, false, 1);
+                std::vector<int16_t> templates = encode(m, r, s, false, true, false, 1);
+                std::vector<int16_t> vectorized = encode(m, r, s, false, false, true, 1);
+                std::vector<int16_t> parallel = encode(m, r, s, false, true, true, 2);
+
+                int vectorized_diff = maxDifference(vectorized, reference);
+                int fixed_diff = maxDifference(fixed, reference);
+                bool ok[6] = {
+                    hash(reference) == golden.reference,
+                    hash(fixed) == golden.fixed_point,
+                    templates == reference,
+                    parallel == templates,
+                    vectorized_diff <= tolerance.vectorized,
+                    fixed_diff <= tolerance.fixed_point
+                };
+                const char *names[6] = {"golden", "golden-fixed", "templates",
+                                        "parallel", "simd", "fixed"};
+
+                char line[96];
+                std::snprintf(line, sizeof(line), "%-8s %s %-4s ", shape_names[shape],
+                              mode_names[mode], symbol_rate_names[rate]);
+                out << line;
+                bool all = true;
+                for (int i = 0; i < 6; i++) {
+                    all = all && ok[i];
+                    if (!ok[i]) {
+                        out << " FAIL:" << names[i];
+                    }
+                }
+                if (all) {
+                    out << " PASS";
+                }
+                out << " (simd " << vectorized_diff << " LSB, fixed "
+                    << fixed_diff << " LSB)" << std::endl;
+                passed = passed && all;
+            }
+        }
+    }
+    for (int i = 0; i < output_case_count; i++) {
+        const OutputCase &output = output_cases[i];
+        bool ok = encodeOutput(i) == output.golden;
+        char line[96];
+        std::snprintf(line, sizeof(line), "output   %-13s", output.name);
+        out << line << (ok ? " PASS" : " FAIL:golden") << std::endl;
+        passed = passed && ok;
+    }
+    passed = checkSetup(out) && passed;
+    out << (passed ? "All checks passed" : "Some checks FAILED") << std::endl;
+    return passed;
+}
+
+/**
+ * @brief Reconfigures an 8 kHz / 1000 Hz encoder and checks it still renders
+ * what a new encoder with the same settings does.
+ * @return true - passed
+ */
+bool PSKSelfCheck::checkSetup(std::ostream &out) {
+    PSK::Config config;
+    config.sample_rate = 8000;
+    config.carrier_freq = 1000;
+    const std::string message = "CQ CQ de N0CALL";
+    std::vector<int16_t> expected;
+    PSK("", PSK::QPSK, PSK::S63, config).encodeTextData(message, expected);
+
+    PSK psk("", PSK::BPSK, PSK::S31, config);
+    psk.setup(PSK::QPSK, PSK::S63); // Keeps config
+    bool kept = psk.config().sample_rate == config.sample_rate
+                && psk.config().carrier_freq == config.carrier_freq;
+
+    PSK::Config invalid;
+    invalid.sample_rate = 3;
+    invalid.carrier_freq = 1;
+    bool threw = false;
+    try {
+        psk.setup(PSK::BPSK, PSK::S1000, invalid);
+    } catch (const std::invalid_argument &) {
+        threw = true;
+    }
+    std::vector<int16_t> samples;
+    bool encoded = psk.encodeTextData(message, samples);
+    bool unchanged = psk.config().sample_rate == config.sample_rate && samples == expected;
+
+    out << "setup   ";
+    if (!kept) {
+        out << " FAIL:keep-config";
+    }
+    if (!threw) {
+        out << " FAIL:no-throw";
+    }
+    if (!encoded || !unchanged) {
+        out << " FAIL:after-throw";
+    }
+    bool all = kept && threw && encoded && unchanged;
+    if (all) {
+        out << " PASS";
+    }
+    out << std::endl;
+    return all;
+}
+
+/**
+ * @brief Prints the golden hash table of the current build as C++, for
+ * pasting into golden_hashes.
+ */
+void PSKSelfCheck::printGolden(std::ostream &out) {
+    for (int shape = 0; shape < 2; shape++) {
+        out << "    { // " << shape_names[shape] << std::endl;
+        for (int mode = 0; mode < 2; mode++) {
+            out << "        { // " << mode_names[mode] << std::endl;
+            for (int rate = 0; rate < 6; rate++) {
+                PSK::Mode m = (PSK::Mode) mode;
+                PSK::PulseShape s = (PSK::PulseShape) shape;
+                PSK::SymbolRate r = symbol_rates[rate];
+                char line[96];
+                std::snprintf(line, sizeof(line),
+                              "            {0x%016llxULL, 0x%016llxULL}, // %s",
+                              (unsigned long long) hash(encode(m, r, s, false, false, false, 1)),
+                              (unsigned long long) hash(encode(m, r, s, true, false, false, 1)),
+                              symbol_rate_names[rate]);
+                out << line << std::endl;
+            }
+            out << "        }," << std::endl;
+        }
+        out << "    }," << std::endl;
+    }
+    out << std::endl << "output_cases:" << std::endl;
+    for (int i = 0; i < output_case_count; i++) {
+        const OutputCase &output = output_cases[i];
+        char line[192];
+        std::snprintf(line, sizeof(line),
+                      "    {\"%s\", PSK::%s, PSK::S%s, %d, %d, PSK::%s, \"%s\", %s,\n"
+                      "     0x%016llxULL},",
+                      output.name, mode_names[output.mode],
+                      symbol_rate_names[output.rate], output.sample_rate,
+                      output.carrier_freq, format_names[output.format],
+                      output.call_sign, sink_names[output.sink],
+                      (unsigned long long) encodeOutput(i));
+        out << line << std::endl;
+    }
+}
+
+// Private Methods
+
+/**
+ * @brief The fixed corpus: every printable ASCII character plus control
+ * characters, repeated until the bit stream is long enough for the parallel
+ * encoder to split it across two threads.
+ */
+std::string PSKSelfCheck::corpus() {
+    std::string text = "CQ CQ de N0CALL\r\n";
+    for (int c = 1; c < 128; c++) {
+        text += (char) c;
+    }
+    std::string message;
+    while (message.size() < 600) {
+        message += text;
+    }
+    return message;
+}
+
+/**
+ * @brief 64 bit FNV-1a hash of the samples (little endian bytes).
+ */
+uint64_t PSKSelfCheck::hash(const std::vector<int16_t> &samples) {
+    uint64_t value = 0xcbf29ce484222325ULL;
+    for (const int16_t &sample : samples) {
+        uint16_t bits = (uint16_t) sample;
+        value = (value ^ (bits & 0xff)) * 0x100000001b3ULL;
+        value = (value ^ (bits >> 8)) * 0x100000001b3ULL;
+    }
+    return value;
+}
+
+/**
+ * @brief 64 bit FNV-1a hash of the bytes of a file or stream.
+ */
+uint64_t PSKSelfCheck::hash(const std::string &bytes) {
+    uint64_t value = 0xcbf29ce484222325ULL;
+    for (const char &byte : bytes) {
+        value = (value ^ (unsigned char) byte) * 0x100000001b3ULL;
+    }
+    return value;
+}
+
+/**
+ * @brief Largest absolute sample difference, or INT_MAX if the lengths
+ * differ.
+ */
+int PSKSelfCheck::maxDifference(const std::vector<int16_t> &a,
+                                const std::vector<int16_t> &b) {
+    if (a.size() != b.size()) {
+        return 0x7fffffff;
+    }
+    int difference = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        difference = std::max(difference, std::abs(a[i] - b[i]));
+    }
+    return difference;
+}
+
+/**
+ * @brief Encodes the corpus with one renderer configuration.
+ */
+std::vector<int16_t> PSKSelfCheck::encode(PSK::Mode mode, PSK::SymbolRate rate,
+                                          PSK::PulseShape shape, bool fixed_point,
+                                          bool templates, bool vectorized,
+                                          int threads) {
+    PSK psk("", mode, rate);
+    psk.setPulseShape(shape);
+    psk.setFixedPoint(fixed_point);
+    psk.setVectorized(vectorized);
+    psk.setSymbolTemplates(templates);
+    psk.setThreads(threads);
+    std::vector<int16_t> samples;
+    psk.encodeTextData(corpus(), samples);
+    return samples;
+}
+
+/**
+ * @brief Encodes the corpus through output_cases[index] and hashes what it
+ * wrote: the samples of a vector or callback, the bytes of a stream or file.
+ * Files are written to the temporary directory and removed.
+ */
+uint64_t PSKSelfCheck::encodeOutput(int index) {
+    const OutputCase &output = output_cases[index];
+    PSK::Config config;
+    config.sample_rate = output.sample_rate;
+    config.carrier_freq = output.carrier_freq;
+    config.sample_format = output.format;
+    const std::string path =
+        (std::filesystem::temp_directory_path() / "psk_selfcheck.wav").string();
+    PSK psk(path, output.mode, output.rate, config);
+    psk.setCallSign(output.call_sign);
+
+    std::vector<int16_t> samples;
+    std::ostringstream stream;
+    switch (output.sink) {
+        case SAMPLE_VECTOR:
+            psk.encodeTextData(corpus(), samples);
+            return hash(samples);
+        case SAMPLE_CALLBACK:
+            psk.encodeTextData(corpus(), [&](const int16_t *block, int count) {
+                samples.insert(samples.end(), block, block + count);
+            });
+            return hash(samples);
+        case OUTPUT_STREAM:
+            psk.encodeTextData(corpus(), stream);
+            return hash(stream.str());
+        case MAPPED_FILE:
+        case WAV_FILE:
+            psk.setMemoryMapped(output.sink == MAPPED_FILE);
+            psk.encodeTextData(corpus());
+            break;
+        case APPENDED:
+            psk.beginTextData(32);
+            psk.appendTextData(corpus());
+            psk.appendTextData("CQ CQ de N0CALL\r\n");
+            psk.endTextData();
+            break;
+    }
+    std::ifstream file(path, std::ios::binary);
+    stream << file.rdbuf();
+    file.close();
+    std::remove(path.c_str());
+    return hash(stream.str());
+}
@@ -0,0 +1,48 @@
+/**
+ * @file PSKSelfCheck.h
+ * @brief Header file that defines PSKSelfCheck, the golden output regression
+ * check behind psk --selfcheck.
+ * @date 2026-10-14
+ * @copyright Copyright (c) 2022
+ * @version 0.1
+ */
+
+#ifndef PSK_SELF_CHECK_H_
+#define PSK_SELF_CHECK_H_
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "PSK.h"
+
+class PSKSelfCheck {
+    public:
+        /**
+         * @brief Allowed differences in LSB. The template cache and the
+         * parallel encoder must always match the reference exactly.
+         */
+        struct Tolerance {
+            int vectorized = 1; // SIMD renderer vs scalar reference
+            int fixed_point = 32; // Integer renderer vs scalar reference
+        };
+
+        static bool run(std::ostream &out, const Tolerance &tolerance);
+        static void printGolden(std::ostream &out);
+
+    private:
+        static bool checkSetup(std::ostream &out);
+        static std::string corpus();
+        static uint64_t hash(const std::vector<int16_t> &samples);
+        static uint64_t hash(const std::string &bytes);
+        static int maxDifference(const std::vector<int16_t> &a,
+                                 const std::vector<int16_t> &b);
+        static std::vector<int16_t> encode(PSK::Mode mode, PSK::SymbolRate rate,
+                                           PSK::PulseShape shape, bool fixed_point,
+                                           bool templates, bool vectorized,
+                                           int threads);
+        static uint64_t encodeOutput(int index);
+};
+
+#endif // PSK_SELF_CHECK_H_
@@ -0,0 +1,525 @@
+/**
+ * @file PSKServer.cpp
+ * @brief Implementation of the psk --serve daemon mode
+ * @details
+ * Every request is one line holding a flat JSON object:
+ * 
+ * {"id": "1", "text": "CQ CQ", "mode": "qpsk", "rate": 250, "file": "/tmp/a.wav"}
+ * 
+ * "text" is required. "mode" (bpsk, qpsk), "rate" (31, 63, 125, 250, 500,
+ * 1000), "sample_rate" and "carrier" are optional and default to the
+ * command line defaults. If "file" is given the audio is written there, in
+ * the optional "format" (pcm16, pcm8, float, adpcm), otherwise it is
+ * returned inline as base64 16 bit little endian PCM.
+ * {"command": "quit"} stops the server. Every request gets one response line:
+ * 
+ * {"id": "1", "ok": true, "samples": 120000, "file": "/tmp/a.wav"}
+ * {"id": "2", "ok": true, "samples": 120000, "pcm": "AAAB..."}
+ * {"id": "3", "ok": false, "error": "..."}
+ * 
+ * Requests are answered in order. With -j N up to N requests are encoded at
+ * the same time, the server reads ahead while earlier ones are still
+ * encoding. Only strings, numbers and booleans are
+ * understood as values, which is all the protocol needs.
+ * 
+ * @date 2026-10-14
+ * @copyright Copyright (c) 2022
+ * @version 0.1
+ */
+
+#include "PSKServer.h"
+
+#include <cctype>
+#include <condition_variable>
+#include <deque>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define PSK_HAVE_UNIX_SOCKETS 1
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Construct a server.
+ * @param threads Encoder threads, see PSKBatch. Up to twice as many requests
+ * are read ahead of the one being answered, so every thread has work.
+ */
+PSKServer::PSKServer(int threads) : batch_(threads), max_in_flight_(2 * threads) {
+}
+
+/**
+ * @brief Answers requests read from 'in' (one per line) on 'out' until the
+ * input ends or a quit command is received.
+ * @return int 0
+ */
+int PSKServer::serve(std::istream &in, std::ostream &out) {
+    pipeline([&](std::string &line) {
+        return static_cast<bool> (std::getline(in, line));
+    }, [&](const std::string &response) {
+        out << response << '\n';
+        out.flush();
+    });
+    return 0;
+}
+
+/**
+ * @brief Listens on a UNIX stream socket and answers requests from one
+ * client at a time, until a quit command is received.
+ * @details Anyone who can connect to the socket can encode, and a "file"
+ * request writes wherever the server process may write: the path is not
+ * restricted to a directory. Create the socket somewhere only trusted users
+ * can reach (mode 0700 directory) or run the server as a user that can only
+ * write where the audio should go.
+ * @param socket_path Removed and recreated if it already exists
+ * @return int 0 after quit, 1 if the socket could not be set up
+ */
+int PSKServer::serveSocket(const std::string &socket_path) {
+#ifdef PSK_HAVE_UNIX_SOCKETS
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("Socket path is too long: " + socket_path);
+    }
+    std::strcpy(address.sun_path, socket_path.c_str());
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        return 1;
+    }
+    unlink(socket_path.c_str());
+    if (bind(listener, reinterpret_cast<sockaddr*> (&address), sizeof(address)) != 0
+        || listen(listener, 8) != 0) {
+        close(listener);
+        return 1;
+    }
+
+    while (!quit_) {
+        int client = accept(listener, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        std::string pending;
+        bool connected = true;
+        pipeline([&](std::string &line) {
+            size_t end;
+            while ((end = pending.find('\n')) == std::string::npos) {
+                char buffer[4096];
+                ssize_t received = recv(client, buffer, sizeof(buffer), 0);
+                if (received <= 0) {
+                    return false;
+                }
+                pending.append(buffer, received);
+            }
+            line = pending.substr(0, end);
+            pending.erase(0, end + 1);
+            return true;
+        }, [&](const std::string &response) {
+            std::string data = response + '\n';
+            size_t sent = 0;
+            while (connected && sent < data.size()) {
+                ssize_t count = send(client, data.data() + sent, data.size() - sent,
+                                     MSG_NOSIGNAL);
+                if (count <= 0) {
+                    connected = false; // Client went away, the rest is dropped
+                    break;
+                }
+                sent += count;
+            }
+        });
+        close(client);
+    }
+    close(listener);
+    unlink(socket_path.c_str());
+    return 0;
+#else
+    (void) socket_path;
+    return 1;
+#endif
+}
+
+/**
+ * @brief Encodes one request line and returns the response line (without
+ * the newline).
+ * @param line 
+ * @return std::string 
+ */
+std::string PSKServer::handleRequest(const std::string &line) {
+    return submitRequest(line).get();
+}
+
+// Private Methods
+
+/**
+ * @brief Reads requests with 'read_line' and writes their responses with
+ * 'write', in request order, until the input ends or a quit command is read.
+ * @details Reading runs ahead of writing: up to max_in_flight_ requests are
+ * encoding on the batch workers while a writer thread waits for the oldest
+ * one. A request that is answered quickly still waits behind the ones
+ * before it. Responses are written even if the client sends nothing more.
+ * @param read_line Returns false at the end of the input
+ * @param write Called on the writer thread
+ */
+void PSKServer::pipeline(const std::function<bool(std::string &line)> &read_line,
+                         const std::function<void(const std::string &response)> &write) {
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::future<std::string>> in_flight;
+    bool reading = true;
+
+    std::thread writer([&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            changed.wait(lock, [&]() { return !in_flight.empty() || !reading; });
+            if (in_flight.empty()) {
+                return;
+            }
+            std::future<std::string> response = std::move(in_flight.front());
+            lock.unlock();
+            write(response.get());
+            lock.lock();
+            in_flight.pop_front(); // Only after it is written, see below
+            changed.notify_all();
+        }
+    });
+
+    std::string line;
+    while (!quit_ && read_line(line)) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+        std::future<std::string> response = submitRequest(line);
+        std::unique_lock<std::mutex> lock(mutex);
+        // The front is being written, so this bounds the requests in flight
+        changed.wait(lock, [&]() { return (int) in_flight.size() <= max_in_flight_; });
+        in_flight.push_back(std::move(response));
+        changed.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        reading = false;
+        changed.notify_all();
+    }
+    writer.join();
+}
+
+/**
+ * @brief Parses one request line and queues its encode.
+ * @return std::future<std::string> The response line, never an exception:
+ * a bad request only fails itself, never the server
+ */
+std::future<std::string> PSKServer::submitRequest(const std::string &line) {
+    std::string id;
+    std::string response;
+    PSKBatch::Job job;
+    std::future<PSKBatch::Result> result;
+    try {
+        if (parseJob(line, id, job, response)) {
+            result = batch_.submit(job);
+        }
+    } catch (const std::exception &e) {
+        response = errorResponse(id, e.what());
+    }
+    if (!result.valid()) { // Answered without encoding
+        std::promise<std::string> answered;
+        answered.set_value(response);
+        return answered.get_future();
+    }
+    return std::async(std::launch::deferred,
+                      [id, job, result = std::move(result)]() mutable {
+        try {
+            return jobResponse(id, job, result.get());
+        } catch (const std::exception &e) {
+            return errorResponse(id, e.what());
+        }
+    });
+}
+
+/**
+ * @brief Parses one request line into a job.
+ * @param id Set to the id of the request as soon as it is parsed
+ * @param response Set if there is nothing to encode: the error or the
+ * answer to a command
+ * @return true - 'job' should be encoded
+ */
+bool PSKServer::parseJob(const std::string &line, std::string &id,
+                         PSKBatch::Job &job, std::string &response) {
+    Request request;
+    std::string error;
+    if (!parseRequest(line, request, error)) {
+        response = errorResponse("", error);
+        return false;
+    }
+    id = request["id"];
+    if (request["command"] == "quit") {
+        quit_ = true;
+        response = "{\"id\": " + quote(id) + ", \"ok\": true}";
+        return false;
+    }
+    if (request.count("text") == 0) {
+        response = errorResponse(id, "Missing text");
+        return false;
+    }
+
+    job.message = request["text"];
+    job.file_path = request["file"];
+    const std::string &mode = request["mode"];
+    if (mode == "qpsk") {
+        job.mode = PSK::QPSK;
+    } else if (mode != "" && mode != "bpsk") {
+        response = errorResponse(id, "Invalid mode: " + mode);
+        return false;
+    }
+    const std::map<std::string, PSK::SymbolRate> rates = {
+        {"31", PSK::S31}, {"63", PSK::S63}, {"125", PSK::S125},
+        {"250", PSK::S250}, {"500", PSK::S500}, {"1000", PSK::S1000}
+    };
+    if (request.count("rate")) {
+        auto rate = rates.find(request["rate"]);
+        if (rate == rates.end()) {
+            response = errorResponse(id, "Invalid rate: " + request["rate"]);
+            return false;
+        }
+        job.symbol_rate = rate->second;
+    }
+    if (request.count("sample_rate")
+        && !parseInteger(request["sample_rate"], 1, PSK::max_sample_rate,
+                         job.config.sample_rate)) {
+        response = errorResponse(id, "Invalid sample_rate: " + request["sample_rate"]);
+        return false;
+    }
+    if (request.count("carrier")
+        && !parseInteger(request["carrier"], 1, PSK::max_sample_rate / 2,
+                         job.config.carrier_freq)) {
+        response = errorResponse(id, "Invalid carrier: " + request["carrier"]);
+        return false;
+    }
+    const std::map<std::string, PSK::SampleFormat> formats = {
+        {"pcm16", PSK::PCM16}, {"pcm8", PSK::PCM8},
+        {"float", PSK::FLOAT32}, {"adpcm", PSK::IMA_ADPCM}
+    };
+    if (request.count("format")) {
+        auto format = formats.find(request["format"]);
+        if (format == formats.end()) {
+            response = errorResponse(id, "Invalid format: " + request["format"]);
+            return false;
+        }
+        job.config.sample_format = format->second;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Builds the response line of an encoded job.
+ */
+std::string PSKServer::jobResponse(const std::string &id, const PSKBatch::Job &job,
+                                   const PSKBatch::Result &result) {
+    if (!result.success) {
+        return errorResponse(id, result.error.empty() ? "Encoding failed" : result.error);
+    }
+    std::string response = "{\"id\": " + quote(id) + ", \"ok\": true";
+    if (job.file_path.empty()) {
+        response += ", \"samples\": " + std::to_string(result.samples.size());
+        response += ", \"pcm\": \"" + base64(result.samples.data(), result.samples.size()) + "\"";
+    } else {
+        response += ", \"file\": " + quote(job.file_path);
+    }
+    return response + "}";
+}
+
+/**
+ * @brief Parses a whole decimal integer in [min, max].
+ * @return false - not a number, trailing characters or out of range
+ */
+bool PSKServer::parseInteger(const std::string &text, long min, long max, int &value) {
+    if (text.empty()) {
+        return false;
+    }
+    char *end;
+    errno = 0;
+    long parsed = std::strtol(text.c_str(), &end, 10);
+    if (errno == ERANGE || *end != '\0' || parsed < min || parsed > max) {
+        return false;
+    }
+    value = (int) parsed;
+    return true;
+}
+
+/**
+ * @brief Parses a flat JSON object into key -> value strings. Numbers and
+ * booleans are kept as their text.
+ * @return false - not a flat JSON object, 'error' says why
+ */
+bool PSKServer::parseRequest(const std::string &line, Request &request,
+                             std::string &error) {
+    size_t pos = 0;
+    auto skipSpace = [&]() {
+        while (pos < line.size() && std::isspace((unsigned char) line[pos])) {
+            pos++;
+        }
+    };
+    auto parseString = [&](std::string &value) {
+        if (pos >= line.size() || line[pos] != '"') {
+            return false;
+        }
+        pos++;
+        value.clear();
+        while (pos < line.size() && line[pos] != '"') {
+            char c = line[pos++];
+            if (c == '\\' && pos < line.size()) {
+                char escape = line[pos++];
+                switch (escape) {
+                    case 'n': c = '\n'; break;
+                    case 'r': c = '\r'; break;
+                    case 't': c = '\t'; break;
+                    case 'b': c = '\b'; break;
+                    case 'f': c = '\f'; break;
+                    case 'u': // Only ASCII is encoded, so only \u00XX is used
+                        if (pos + 4 > line.size()) {
+                            return false;
+                        }
+                        for (size_t i = pos; i < pos + 4; i++) {
+                            if (!std::isxdigit((unsigned char) line[i])) {
+                                error = "Invalid \\u escape";
+                                return false;
+                            }
+                        }
+                        c = (char) std::strtol(line.substr(pos, 4).c_str(), nullptr, 16);
+                        pos += 4;
+                        break;
+                    default: c = escape; break; // \" \\ \/
+                }
+            }
+            value += c;
+        }
+        if (pos >= line.size()) {
+            return false;
+        }
+        pos++;
+        return true;
+    };
+
+    skipSpace();
+    if (pos >= line.size() || line[pos++] != '{') {
+        error = "Request must be a JSON object";
+        return false;
+    }
+    skipSpace();
+    if (pos < line.size() && line[pos] == '}') {
+        return true;
+    }
+    while (true) {
+        std::string key;
+        std::string value;
+        skipSpace();
+        if (!parseString(key)) {
+            if (error.empty()) {
+                error = "Expected a string key";
+            }
+            return false;
+        }
+        skipSpace();
+        if (pos >= line.size() || line[pos++] != ':') {
+            error = "Expected ':' after " + key;
+            return false;
+        }
+        skipSpace();
+        if (pos < line.size() && line[pos] == '"') {
+            if (!parseString(value)) {
+                if (error.empty()) {
+                    error = "Unterminated string for " + key;
+                }
+                return false;
+            }
+        } else {
+            size_t end = line.find_first_of(",} \t\r", pos);
+            value = line.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+            if (value.empty() || value[0] == '{' || value[0] == '[') {
+                error = "Unsupported value for " + key;
+                return false;
+            }
+            pos = end == std::string::npos ? line.size() : end;
+        }
+        request[key] = value;
+        skipSpace();
+        if (pos < line.size() && line[pos] == ',') {
+            pos++;
+            continue;
+        }
+        if (pos < line.size() && line[pos] == '}') {
+            return true;
+        }
+        error = "Expected ',' or '}'";
+        return false;
+    }
+}
+
+/**
+ * @brief Returns 'value' as a JSON string literal.
+ */
+std::string PSKServer::quote(const std::string &value) {
+    std::string quoted = "\"";
+    for (const char &c : value) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if ((unsigned char) c < 0x20) {
+            char escape[8];
+            std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+            quoted += escape;
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+/**
+ * @brief Base64 encodes 16 bit samples as little endian bytes.
+ */
+std::string PSKServer::base64(const int16_t *samples, size_t count) {
+    static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const unsigned char *bytes = reinterpret_cast<const unsigned char*> (samples);
+    const size_t length = count * sizeof(int16_t);
+    std::string encoded;
+    encoded.reserve((length + 2) / 3 * 4);
+    size_t i = 0;
+    for (; i + 2 < length; i += 3) {
+        uint32_t group = (bytes[i] << 16) | (bytes[i + 1] << 8) | bytes[i + 2];
+        encoded += alphabet[(group >> 18) & 63];
+        encoded += alphabet[(group >> 12) & 63];
+        encoded += alphabet[(group >> 6) & 63];
+        encoded += alphabet[group & 63];
+    }
+    if (i < length) { // 1 or 2 bytes left
+        uint32_t group = bytes[i] << 16;
+        if (i + 1 < length) {
+            group |= bytes[i + 1] << 8;
+        }
+        encoded += alphabet[(group >> 18) & 63];
+        encoded += alphabet[(group >> 12) & 63];
+        encoded += i + 1 < length ? alphabet[(group >> 6) & 63] : '=';
+        encoded += '=';
+    }
+    return encoded;
+}
+
+/**
+ * @brief Builds a failure response line.
+ */
+std::string PSKServer::errorResponse(const std::string &id, const std::string &error) {
+    return "{\"id\": " + quote(id) + ", \"ok\": false, \"error\": " + quote(error) + "}";
+}
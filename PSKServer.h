@@ -0,0 +1,59 @@
+/**
+ * @file PSKServer.h
+ * @brief Header file that defines the PSKServer class, a long running
+ * encoder that answers newline delimited JSON requests.
+ * @date 2026-10-14
+ * @copyright Copyright (c) 2022
+ * @version 0.1
+ */
+
+#ifndef PSK_SERVER_H_
+#define PSK_SERVER_H_
+
+#include <functional>
+#include <future>
+#include <iostream>
+#include <map>
+#include <string>
+
+#include "PSKBatch.h"
+
+class PSKServer {
+    public:
+        explicit PSKServer(int threads);
+
+        int serve(std::istream &in, std::ostream &out);
+        int serveSocket(const std::string &socket_path);
+
+        std::string handleRequest(const std::string &line);
+
+    private:
+        using Request = std::map<std::string, std::string>;
+
+        void pipeline(const std::function<bool(std::string &line)> &read_line,
+                      const std::function<void(const std::string &response)> &write);
+        std::future<std::string> submitRequest(const std::string &line);
+        bool parseJob(const std::string &line, std::string &id, PSKBatch::Job &job,
+                      std::string &response);
+        static std::string jobResponse(const std::string &id, const PSKBatch::Job &job,
+                                       const PSKBatch::Result &result);
+        static bool parseRequest(const std::string &line, Request &request,
+                                 std::string &error);
+        static bool parseInteger(const std::string &text, long min, long max,
+                                 int &value);
+        static std::string quote(const std::string &value);
+        static std::string base64(const int16_t *samples, size_t count);
+        static std::string errorResponse(const std::string &id, const std::string &error);
+
+        /**
+         * @details The encoders live in the batch encoder, which keeps the
+         * most recently used ones per worker and per mode/symbol rate/config.
+         * They stay warm (symbol templates and pulse tables built), so a
+         * request with recently used settings only pays for modulation.
+         */
+        PSKBatch batch_;
+        int max_in_flight_; // Requests read ahead of the one being answered
+        bool quit_ = false;
+};
+
+#endif // PSK_SERVER_H_
@@ -0,0 +1,37 @@
+/**
+ * @file PSKSimd.h
+ * @brief Vectorized symbol rendering kernels with runtime CPU dispatch.
+ * @date 2026-10-14
+ * @copyright Copyright (c) 2022
+ * @version 0.1
+ */
+
+#ifndef PSK_SIMD_H_
+#define PSK_SIMD_H_
+
+#include <cstdint>
+
+/**
+ * @brief Renders 'count' samples of envelope[i] * cos(2pi * (start_turns +
+ * i * step_turns)), truncated and saturated to 16 bits.
+ * @details Uses the widest kernel the CPU supports (AVX2, SSE2 or NEON,
+ * 8 samples per iteration) or a scalar fallback. The cosine is a polynomial
+ * approximation accurate to far below 1 LSB, so the output can differ from
+ * std::cos by +-1 LSB.
+ * 
+ * @param out Buffer of at least 'count' samples
+ * @param envelope Per sample amplitude (already scaled to the sample range)
+ * @param start_turns Carrier phase of the first sample in turns (1 = 360 deg)
+ * @param step_turns Carrier phase increment per sample in turns
+ * @param count Number of samples
+ */
+void renderCarrierSimd(int16_t *out, const float *envelope, double start_turns,
+                       double step_turns, int count);
+
+/**
+ * @brief Name of the kernel selected by renderCarrierSimd() on this CPU.
+ * @return const char* "avx2", "sse2", "neon" or "scalar"
+ */
+const char *simdKernelName();
+
+#endif // PSK_SIMD_H_
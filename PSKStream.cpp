@@ -0,0 +1,181 @@
+/**
+ * @file PSKStream.cpp
+ * @brief Implementation of the streaming BPSK and QPSK modulator
+ * @details
+ * PSKStream produces the same audio as PSK::encodeTextData, but text can be
+ * pushed while the audio is being pulled. Varicode and the convolutional
+ * code are applied one bit at a time as samples are requested. Like the bit
+ * stream of encodeTextData, the postamble is padded with 1's to a 32 bit
+ * boundary first and the end is padded with 0's to a 32 bit boundary. There
+ * is no CW ID, so the audio only matches encodeTextData without a callsign,
+ * and only if the text was pushed before the stream ran out of it.
+ * 
+ * If the pushed text runs out before finish() is called, the stream sends
+ * idle (0 bits, continuous phase reversals) until more text arrives. After
+ * finish() the remaining text is sent followed by the postamble, and then
+ * pull() returns fewer samples than requested.
+ * 
+ * @date 2026-10-14
+ * @copyright Copyright (c) 2022
+ * @version 0.1
+ */
+
+#include "PSKStream.h"
+
+#include <cstring>
+#include <algorithm>
+
+/**
+ * @brief Construct a streaming PSK modulator.
+ * @param mode BPSK or QPSK
+ * @param sym_rate Symbol rate
+ * @param config Sample rate, carrier and preamble/postamble length
+ */
+PSKStream::PSKStream(PSK::Mode mode, PSK::SymbolRate sym_rate,
+                     const PSK::Config &config)
+    : psk_("", mode, sym_rate, config) {
+    psk_.resetState();
+    stage_bits_left_ = psk_.preamble_length_;
+    if (stage_bits_left_ == 0) {
+        stage_ = TEXT;
+    }
+    symbol_scratch_.resize(psk_.samples_per_symbol_ + 1);
+}
+
+/**
+ * @brief Queue a character to be sent.
+ * @param c 
+ */
+void PSKStream::push(char c) {
+    if (finished_) {
+        throw std::logic_error("Cannot push text after finish()");
+    }
+    text_.push_back(c);
+}
+
+/**
+ * @brief Queue a string to be sent.
+ * @param text 
+ */
+void PSKStream::push(const std::string &text) {
+    for (const char &c : text) {
+        push(c);
+    }
+}
+
+/**
+ * @brief Marks the end of the message. The queued text is still sent,
+ * followed by the postamble.
+ */
+void PSKStream::finish() {
+    finished_ = true;
+}
+
+/**
+ * @brief Renders up to 'count' samples into 'out'.
+ * @param out Buffer for at least 'count' 16 bit mono samples
+ * @param count Number of samples requested
+ * @return size_t Number of samples written. Less than 'count' only once the
+ * postamble after finish() has been fully sent.
+ */
+size_t PSKStream::pull(int16_t *out, size_t count) {
+    size_t written = 0;
+    while (written < count) {
+        if (symbol_offset_ == symbol_length_ && !renderNextSymbol()) {
+            break;
+        }
+        size_t n = std::min(count - written, (size_t) (symbol_length_ - symbol_offset_));
+        std::memcpy(out + written, symbol_ + symbol_offset_, n * sizeof(int16_t));
+        symbol_offset_ += n;
+        written += n;
+    }
+    return written;
+}
+
+/**
+ * @brief Returns true once all samples, including the postamble, have been
+ * pulled.
+ */
+bool PSKStream::done() const {
+    return next_bit_ == -1 && symbol_offset_ == symbol_length_;
+}
+
+/**
+ * @brief Modulates the next bit into the current symbol buffer.
+ * @return false - there are no more bits to send
+ */
+bool PSKStream::renderNextSymbol() {
+    if (next_bit_ == -2) { // First symbol, text pushed before now is not idle
+        next_bit_ = nextSourceBit();
+    }
+    int bit = next_bit_;
+    if (bit == -1) {
+        return false;
+    }
+    next_bit_ = nextSourceBit();
+
+    int phase;
+    int transition;
+    psk_.mapSymbol(psk_.encoder_, bit, next_bit_, phase, transition);
+    symbol_ = psk_.nextSymbolSamples(phase, transition, symbol_scratch_.data(),
+                                     symbol_length_);
+    symbol_offset_ = 0;
+    return true;
+}
+
+/**
+ * @brief Produces the next bit to modulate: preamble, varicode of the queued
+ * text (or idle), then postamble.
+ * @return int [1, 0, -1] -1 = end of stream
+ */
+int PSKStream::nextSourceBit() {
+    int bit = sourceBit();
+    if (bit != -1) {
+        bits_sent_++;
+    }
+    return bit;
+}
+
+/**
+ * @brief The bit for nextSourceBit(), bits_sent_ is the number of bits
+ * before it.
+ */
+int PSKStream::sourceBit() {
+    switch (stage_) {
+        case PREAMBLE:
+            if (--stage_bits_left_ == 0) {
+                stage_ = TEXT;
+            }
+            return 0;
+        case TEXT:
+            if (varicode_bits_left_ == 0) {
+                if (text_.empty()) {
+                    if (!finished_) {
+                        return 0; // Idle until more text arrives
+                    }
+                    // Padded to a whole word first, see PSK::addPostamble()
+                    stage_bits_left_ = (32 - bits_sent_ % 32) % 32 + psk_.postamble_length_;
+                    stage_ = stage_bits_left_ > 0 ? POSTAMBLE : END;
+                    return sourceBit();
+                }
+                const VaricodeWord &word = varicode_words.words[text_.front() & 0x7f];
+                text_.pop_front();
+                varicode_ = word.bits; // Two 0's after each character
+                varicode_bits_left_ = word.length;
+            }
+            varicode_bits_left_--;
+            return (varicode_ >> varicode_bits_left_) & 1;
+        case POSTAMBLE:
+            if (--stage_bits_left_ == 0) {
+                stage_ = (bits_sent_ + 1) % 32 ? PADDING : END;
+            }
+            return 1;
+        case PADDING: // 0's to the end of the last word, see PSK::pushBufferToBitStream()
+            if ((bits_sent_ + 1) % 32 == 0) {
+                stage_ = END;
+            }
+            return 0;
+        default:
+            return -1;
+    }
+}
@@ -0,0 +1,67 @@
+/**
+ * @file PSKStream.h
+ * @brief Header file that defines the PSKStream class, a pull based PSK
+ * modulator that accepts text incrementally.
+ * @date 2026-10-14
+ * @copyright Copyright (c) 2022
+ * @version 0.1
+ */
+
+#ifndef PSK_STREAM_H_
+#define PSK_STREAM_H_
+
+#include <deque>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+#include "PSK.h"
+
+class PSKStream {
+    public:
+        PSKStream(PSK::Mode mode, PSK::SymbolRate sym_rate,
+                  const PSK::Config &config = PSK::Config());
+
+        void push(char c);
+        void push(const std::string &text);
+        void finish();
+        size_t pull(int16_t *out, size_t count);
+        bool done() const;
+
+    private:
+        int nextSourceBit();
+        int sourceBit();
+        bool renderNextSymbol();
+
+        enum Stage {
+            PREAMBLE,
+            TEXT,
+            POSTAMBLE,
+            PADDING,
+            END
+        };
+
+        /**
+         * @details The modulator that is driven one symbol at a time. Its
+         * symbol templates, carrier phase, filter state and BPSK/QPSK encoder
+         * state are used directly, so the stream only holds the characters
+         * that have not been encoded yet plus a constant amount of state.
+         */
+        PSK psk_;
+        std::deque<char> text_;
+        bool finished_ = false;
+
+        Stage stage_ = PREAMBLE;
+        int stage_bits_left_; // Preamble/postamble bits left to send
+        uint64_t bits_sent_ = 0; // Bits returned by nextSourceBit()
+        uint32_t varicode_ = 0; // Current character with '00' appended
+        int varicode_bits_left_ = 0;
+        int next_bit_ = -2; // One bit lookahead for the filter [1, 0, -1], -2 = not read yet
+
+        std::vector<int16_t> symbol_scratch_;
+        const int16_t *symbol_ = nullptr; // Samples of the current symbol
+        int symbol_length_ = 0; // Samples in the current symbol
+        int symbol_offset_ = 0; // Samples of the current symbol already pulled
+};
+
+#endif // PSK_STREAM_H_
@@ -0,0 +1,151 @@
+/**
+ * @file ThreadPool.cpp
+ * @brief Implementation of the thread pool
+ * @date 2026-10-14
+ * @copyright Copyright (c) 2022
+ * @version 0.1
+ */
+
+#include "ThreadPool.h"
+
+#include <stdexcept>
+
+// The pool and worker index of the current thread, if it is a pool worker
+static thread_local ThreadPool *current_pool = nullptr;
+static thread_local int current_worker = -1;
+
+/**
+ * @brief Starts 'threads' worker threads.
+ * @param threads Must be at least 1
+ */
+ThreadPool::ThreadPool(int threads) {
+    if (threads < 1) {
+        throw std::invalid_argument("Thread pool needs at least 1 thread");
+    }
+    for (int i = 0; i < threads; i++) {
+        queues_.emplace_back(new WorkerQueue());
+    }
+    for (int i = 0; i < threads; i++) {
+        workers_.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+/**
+ * @brief Finishes all queued tasks and joins the workers.
+ */
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stopping_ = true;
+    }
+    task_available_.notify_all();
+    for (std::thread &worker : workers_) {
+        worker.join();
+    }
+}
+
+int ThreadPool::size() const {
+    return workers_.size();
+}
+
+/**
+ * @brief Queues a task to run on one of the workers.
+ * @param task 
+ */
+void ThreadPool::submit(Task task) {
+    int queue = current_pool == this ? current_worker
+                                     : next_queue_++ % queues_.size();
+    {
+        std::lock_guard<std::mutex> lock(queues_[queue]->mutex);
+        queues_[queue]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        pending_++;
+    }
+    task_available_.notify_one();
+}
+
+/**
+ * @brief Runs fn(index, worker) for every index in [0, count) on the pool and
+ * waits for all of them to finish. Must not be called from a pool task.
+ * @details If any call throws, the first exception is rethrown after all
+ * calls have finished.
+ * @param count 
+ * @param fn 
+ */
+void ThreadPool::parallelFor(int count, const std::function<void(int index, int worker)> &fn) {
+    std::mutex done_mutex;
+    std::condition_variable done;
+    int remaining = count;
+    std::exception_ptr error;
+
+    for (int i = 0; i < count; i++) {
+        submit([&, i](int worker) {
+            std::exception_ptr task_error;
+            try {
+                fn(i, worker);
+            } catch (...) {
+                task_error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(done_mutex);
+            if (task_error && !error) {
+                error = task_error;
+            }
+            if (--remaining == 0) {
+                done.notify_one();
+            }
+        });
+    }
+
+    std::unique_lock<std::mutex> lock(done_mutex);
+    done.wait(lock, [&] { return remaining == 0; });
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void ThreadPool::workerLoop(int worker) {
+    current_pool = this;
+    current_worker = worker;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            task_available_.wait(lock, [this] { return stopping_ || pending_ > 0; });
+            if (pending_ == 0) { // Stopping and nothing left to do
+                return;
+            }
+        }
+        Task task;
+        if (takeTask(worker, task)) {
+            task(worker);
+        }
+    }
+}
+
+/**
+ * @brief Takes a task from the back of the worker's own queue, or steals one
+ * from the front of another queue.
+ * @return false - no task was available
+ */
+bool ThreadPool::takeTask(int worker, Task &task) {
+    const int num_queues = queues_.size();
+    for (int i = 0; i < num_queues; i++) {
+        WorkerQueue &queue = *queues_[(worker + i) % num_queues];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            continue;
+        }
+        if (i == 0) { // Own queue, newest first
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else { // Steal the oldest task
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        std::lock_guard<std::mutex> sleep_lock(sleep_mutex_);
+        pending_--;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,62 @@
+/**
+ * @file ThreadPool.h
+ * @brief Header file that defines a small fixed size work stealing thread pool
+ * used by the parallel and batch encoders.
+ * @date 2026-10-14
+ * @copyright Copyright (c) 2022
+ * @version 0.1
+ */
+
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+    public:
+        /**
+         * @brief A task receives the index of the worker that runs it
+         * [0 - size()), so that it can use per worker state.
+         */
+        using Task = std::function<void(int worker)>;
+
+        explicit ThreadPool(int threads);
+        ~ThreadPool();
+
+        int size() const;
+        void submit(Task task);
+        void parallelFor(int count, const std::function<void(int index, int worker)> &fn);
+
+    private:
+        /**
+         * @details Every worker has its own queue. A worker runs tasks from
+         * the back of its own queue and, when that is empty, steals from the
+         * front of the other queues. Tasks submitted from outside the pool are
+         * spread over the queues round robin, tasks submitted by a worker go
+         * to its own queue.
+         */
+        struct WorkerQueue {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        void workerLoop(int worker);
+        bool takeTask(int worker, Task &task);
+
+        std::vector<std::unique_ptr<WorkerQueue>> queues_;
+        std::vector<std::thread> workers_;
+        std::atomic<unsigned> next_queue_{0};
+        int pending_ = 0; // Queued tasks, guarded by sleep_mutex_
+        std::mutex sleep_mutex_;
+        std::condition_variable task_available_;
+        bool stopping_ = false;
+};
+
+#endif // THREAD_POOL_H_
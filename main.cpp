@@ -0,0 +1,285 @@
+/**
+ * @file main.cpp
+ * @brief Command line interface of the psk modulator. Everything else is in
+ * the library (libpsk.a).
+ * @date 2026-10-14
+ * @copyright Copyright (c) 2022
+ * @version 0.1
+ */
+
+#include "PSK.h"
+#include "PSKDemodulator.h"
+#include "PSKSelfCheck.h"
+#include "PSKServer.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Main function for when using as a command line utility.
+ * @details
+ * Usage: ./psk -m [mode] -s [symbol_rate] -f [filename] -r [sample_rate]
+ * -c [carrier_freq] -p [pulse_shape] -iq [oversampling] -j [threads] [-raw]
+ * -t "text to encode" [--stats]
+ * -f - writes the audio to stdout
+ * or ./psk --serve [socket_path] -j [threads] # daemon, see PSKServer.cpp
+ * or ./psk --selfcheck [--tolerance lsb] [--golden] # see PSKSelfCheck.cpp
+ * or echo "test" | ./psk # uses defaults 
+ */
+int main(int argc, char** argv) {
+    std::string message = "";
+    std::string filename = "out.wav";
+    PSK::Mode mode = PSK::BPSK;
+    PSK::SymbolRate symbol_rate = PSK::S125;
+
+    int threads = 1;
+    PSK::Config config;
+    PSK::PulseShape pulse_shape = PSK::ENVELOPE;
+    int iq_oversampling = 0; // 0 = audio output
+    int queue_idle = -1; // idle symbols between queued messages, -1 = off
+    bool raw_output = false;
+    bool stream_output = false; // Write the wav file without mmap
+    bool print_stats = false;
+    std::string call_sign = ""; // Empty = no CW ID
+    bool self_check = false;
+    bool print_golden = false;
+    bool verify = false; // Decode the audio in memory instead of writing it
+    PSKSelfCheck::Tolerance tolerance;
+    bool serve = false;
+    std::string socket_path = ""; // Empty = serve on stdin/stdout
+    int message_flag = 0;
+
+    // With -f - the audio goes to stdout, so everything else goes to stderr
+    std::streambuf *stdout_buffer = std::cout.rdbuf();
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::string(argv[i]) == "-f" && std::string(argv[i + 1]) == "-") {
+            std::cout.rdbuf(std::cerr.rdbuf());
+        }
+    }
+
+    for (int i = 0; i < argc; i++) {
+        if (std::string(argv[i]) == "-m") {
+            std::cout << "mode" << std::endl;
+            if (std::string(argv[i + 1]) == "bpsk") {
+                mode = PSK::BPSK;
+            } else if (std::string(argv[i + 1]) == "qpsk") {
+                mode = PSK::QPSK;
+            } else {
+                std::cout << "Invalid mode: -m bpsk | -m qpsk" << std::endl;
+                return 1;
+            }
+        }
+        if (std::string(argv[i]) == "-s") {
+            if (std::string(argv[i + 1]) == "31") {
+                symbol_rate = PSK::S31;
+            } else if (std::string(argv[i + 1]) == "63") {
+                symbol_rate = PSK::S63;
+            } else if (std::string(argv[i + 1]) == "125") {
+                symbol_rate = PSK::S125;
+            } else if (std::string(argv[i + 1]) == "250") {
+                symbol_rate = PSK::S250;
+            } else if (std::string(argv[i + 1]) == "500") {
+                symbol_rate = PSK::S500;
+            } else if (std::string(argv[i + 1]) == "1000") {
+                symbol_rate = PSK::S1000;
+            } else {
+                std::cout << "Invalid symbol rate: -s 31 | -s 63 | -s 125 | -s 250 | -s 500 | -s 1000" << std::endl;
+                return 1;
+            }
+        }
+        if (std::string(argv[i]) == "-f") {
+           filename = std::string(argv[i + 1]);
+        }
+        if (std::string(argv[i]) == "-r") {
+            config.sample_rate = std::atoi(argv[i + 1]);
+        }
+        if (std::string(argv[i]) == "-c") {
+            config.carrier_freq = std::atoi(argv[i + 1]);
+        }
+        if (std::string(argv[i]) == "-format") {
+            const std::string format = argv[i + 1];
+            if (format == "pcm16") {
+                config.sample_format = PSK::PCM16;
+            } else if (format == "pcm8") {
+                config.sample_format = PSK::PCM8;
+            } else if (format == "float") {
+                config.sample_format = PSK::FLOAT32;
+            } else if (format == "adpcm") {
+                config.sample_format = PSK::IMA_ADPCM;
+            } else {
+                std::cout << "Invalid sample format" << std::endl;
+                return 1;
+            }
+        }
+        if (std::string(argv[i]) == "-p") {
+            if (std::string(argv[i + 1]) == "envelope") {
+                pulse_shape = PSK::ENVELOPE;
+            } else if (std::string(argv[i + 1]) == "rc") {
+                pulse_shape = PSK::RAISED_COSINE;
+            } else {
+                std::cout << "Invalid pulse shape: -p envelope | -p rc" << std::endl;
+                return 1;
+            }
+        }
+        if (std::string(argv[i]) == "--selfcheck") {
+            self_check = true;
+        }
+        if (std::string(argv[i]) == "--verify") {
+            verify = true;
+        }
+        if (std::string(argv[i]) == "--golden") {
+            print_golden = true;
+        }
+        if (std::string(argv[i]) == "--tolerance") {
+            tolerance.vectorized = std::atoi(argv[i + 1]);
+        }
+        if (std::string(argv[i]) == "--serve") {
+            serve = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                socket_path = std::string(argv[i + 1]);
+            }
+        }
+        if (std::string(argv[i]) == "-nommap") {
+            stream_output = true;
+        }
+        if (std::string(argv[i]) == "-id") {
+            call_sign = std::string(argv[i + 1]);
+        }
+        if (std::string(argv[i]) == "--stats") {
+            print_stats = true;
+        }
+        if (std::string(argv[i]) == "-raw") {
+            raw_output = true;
+        }
+        if (std::string(argv[i]) == "-queue") {
+            queue_idle = std::atoi(argv[i + 1]);
+            if (queue_idle < 0) {
+                std::cout << "Invalid idle length: -queue 32" << std::endl;
+                return 1;
+            }
+        }
+        if (std::string(argv[i]) == "-iq") {
+            iq_oversampling = std::atoi(argv[i + 1]);
+        }
+        if (std::string(argv[i]) == "-j") {
+            threads = std::atoi(argv[i + 1]);
+            if (threads < 1) {
+                std::cout << "Invalid number of threads: -j 1 | -j 4" << std::endl;
+                return 1;
+            }
+        }
+        if (std::string(argv[i]) == "-t") {
+            message = std::string(argv[i + 1]);
+            message_flag = 1;
+        }
+    }
+
+    if (self_check) { // See PSKSelfCheck.cpp
+        if (print_golden) {
+            PSKSelfCheck::printGolden(std::cout);
+            return 0;
+        }
+        return PSKSelfCheck::run(std::cout, tolerance) ? 0 : 1;
+    }
+
+    if (serve) { // See PSKServer.cpp for the request format
+        try {
+            PSKServer server(threads);
+            if (socket_path.empty()) {
+                return server.serve(std::cin, std::cout);
+            }
+            return server.serveSocket(socket_path);
+        } catch (const std::invalid_argument &e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    if (!message_flag) {
+        std::cout << "Enter message (Ctrl+D after newline to end): \n";
+        std::string line;
+        std::stringstream buffer;
+        while (std::getline(std::cin, line)){
+            buffer << line;
+            buffer << "\n";
+        }
+        message = buffer.str();
+    }
+
+    if (message.size() < 2) {
+        std::cout << "No message detected!" << std::endl;
+        return 1;
+    } else {
+        std::cout << std::endl << "Encoding message: \n" << message << std::endl;
+    }
+
+    std::cout << "Mode: " << (mode == PSK::BPSK ? "BPSK" : "QPSK") << ", ";
+    const char *symbol_rate_names[] = {"31.25", "62.5", "125", "250", "500", "1000"};
+    std::cout << "Symbol Rate: " << symbol_rate_names[symbol_rate] << ", ";
+    std::cout << "Sample Rate: " << config.sample_rate << ", ";
+    std::cout << "Carrier: " << config.carrier_freq << ", ";
+    std::cout << "Filename: " << filename << std::endl;
+    std::cout << "Generating audio file..." << std::endl;
+
+    try {
+        PSK psk(filename, mode, symbol_rate, config);
+        psk.setThreads(threads);
+        psk.setPulseShape(pulse_shape);
+        psk.setStats(print_stats);
+        psk.setCallSign(call_sign);
+        if (verify) { // See PSKDemodulator.cpp
+            std::vector<int16_t> samples;
+            psk.encodeTextData(message, samples);
+            PSKDemodulator demodulator(mode, symbol_rate, config, call_sign);
+            long long errors = demodulator.bitErrors(message, samples.data(), samples.size());
+            bool text_ok = demodulator.decodeText(samples) == message;
+            std::cout << "Verify: " << (errors == 0 && text_ok ? "OK" : "FAILED") << ", ";
+            std::cout << "Bit errors: " << errors << ", ";
+            std::cout << "Text: " << (text_ok ? "matches" : "differs") << std::endl;
+            return errors == 0 && text_ok ? 0 : 1;
+        }
+        if (filename == "-") {
+            if (iq_oversampling > 0) {
+                std::cout << "I/Q output can not be written to stdout" << std::endl;
+                return 1;
+            }
+            std::ostream audio_out(stdout_buffer);
+            psk.setOutputChunkSize(1024); // ~23 ms at 44.1 kHz
+            if (!psk.encodeTextData(message, audio_out, !raw_output)) {
+                return 1; // Reader went away
+            }
+        } else if (iq_oversampling > 0) {
+            psk.encodeTextDataIQ(message, iq_oversampling);
+        } else if (queue_idle >= 0) { // One message per line, in one transmission
+            psk.beginTextData(queue_idle);
+            std::stringstream lines(message);
+            std::string line;
+            while (std::getline(lines, line)) {
+                if (!line.empty()) {
+                    psk.appendTextData(line + "\n");
+                }
+            }
+            psk.endTextData();
+        } else {
+            psk.setMemoryMapped(!stream_output);
+            psk.encodeTextData(message);
+        }
+        if (print_stats) {
+            const PSK::Stats &stats = psk.stats();
+            std::cout << "Bit stream: " << stats.bit_stream_seconds * 1000 << " ms, ";
+            std::cout << "Modulation: " << stats.modulation_seconds * 1000 << " ms, ";
+            std::cout << "I/O: " << stats.io_seconds * 1000 << " ms" << std::endl;
+            std::cout << "Symbols: " << stats.symbols << ", ";
+            std::cout << "Samples: " << stats.samples << ", ";
+            std::cout << "Bytes written: " << stats.bytes_written << ", ";
+            std::cout << "Peak buffers: " << stats.peak_buffer_bytes << " bytes" << std::endl;
+        }
+    } catch (const std::invalid_argument &e) {
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
\ No newline at end of file